@@ -0,0 +1,46 @@
+void *Arena::allocate(u64 size, u64 alignment) {
+    u8 *p = (u8 *)(((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1));
+
+    if (!cursor || p + size > limit) {
+        const u64 max_chunk_size = 16 * 1024 * 1024;
+
+        u64 chunk_size = next_chunk_size;
+        if (chunk_size < size + alignment + sizeof(Chunk)) {
+            // oversized allocations get a chunk of their own
+            chunk_size = size + alignment + sizeof(Chunk);
+        } else if (next_chunk_size < max_chunk_size) {
+            next_chunk_size *= 2;
+        }
+
+        auto chunk = (Chunk *)malloc(chunk_size);
+        assert(chunk);
+        chunk->next = chunks;
+        chunk->size = chunk_size;
+        chunks = chunk;
+
+        cursor = (u8 *)(chunk + 1);
+        limit  = (u8 *)chunk + chunk_size;
+
+        p = (u8 *)(((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+
+    cursor = p + size;
+    return p;
+}
+
+void Arena::release() {
+    // newest first, like a stack
+    for (auto f = finalizers; f; f = f->next) {
+        f->destroy(f->object);
+    }
+    finalizers = nullptr;
+
+    while (chunks) {
+        auto next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+
+    cursor = limit = nullptr;
+    next_chunk_size = 64 * 1024;
+}
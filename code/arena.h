@@ -0,0 +1,118 @@
+/* @note
+ * A bump pointer arena, one per compilation unit, for everything the parser
+ * and IL conversion create. Memory comes in chunks that grow as the arena
+ * does, and release() gives it all back at once.
+ *
+ * The AST keeps its arrays in the arena too (Arena_Array), so it's dropped
+ * with the chunks without visiting a node. What still has a destructor
+ * registers a finalizer: an IL::Module, each IL::Function, whose arrays
+ * passes keep rewriting and are better off on the heap, and the arenas of
+ * the parser's workers. So release() is O(chunks + functions).
+ */
+struct Arena {
+    struct Chunk {
+        Chunk *next;
+        u64 size;
+    };
+
+    struct Finalizer {
+        Finalizer *next;
+        void (*destroy)(void *object);
+        void *object;
+    };
+
+    u8 *cursor = nullptr;
+    u8 *limit  = nullptr;
+    Chunk *chunks = nullptr;
+    Finalizer *finalizers = nullptr;
+
+    u64 next_chunk_size = 64 * 1024;
+
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena() { release(); }
+
+    void *allocate(u64 size, u64 alignment);
+    void release();
+
+    template <typename T, typename... Args>
+    T *make(Args &&... args) {
+        void *memory = allocate(sizeof(T), alignof(T));
+        T *object = new (memory) T(std::forward<Args>(args)...);
+
+        if (!std::is_trivially_destructible<T>::value) {
+            auto finalizer = (Finalizer *)allocate(sizeof(Finalizer), alignof(Finalizer));
+            finalizer->next    = finalizers;
+            finalizer->destroy = [](void *o) { ((T *)o)->~T(); };
+            finalizer->object  = object;
+            finalizers = finalizer;
+        }
+
+        return object;
+    }
+};
+
+/* @note
+ * An array that grows inside an arena, for things that are built up once
+ * and then read, like the AST. It has no destructor, so what holds it can
+ * be dropped with its chunk. Growing leaves the old storage behind until
+ * release(), unless it was the last thing the arena handed out, then it
+ * grows in place. Items are moved with memcpy.
+ */
+template <typename T>
+struct Arena_Array {
+    static_assert(std::is_trivially_copyable<T>::value, "Arena_Array items are moved with memcpy");
+
+    Arena *arena;
+    T *items = nullptr;
+    u32 count = 0;
+    u32 capacity = 0;
+
+    explicit Arena_Array(Arena *arena) : arena(arena) {}
+
+    u32 size() const  { return count; }
+    bool empty() const { return count == 0; }
+
+    T *data()  { return items; }
+    T *begin() { return items; }
+    T *end()   { return items + count; }
+
+    T &operator[](u32 i) { return items[i]; }
+    T &back() { return items[count - 1]; }
+
+    void push_back(const T &item) {
+        if (count == capacity) reserve(count + 1);
+        items[count++] = item;
+    }
+
+    void append(const T *first, u32 n) {
+        reserve(count + n);
+        if (n) memcpy(items + count, first, n * sizeof(T));
+        count += n;
+    }
+
+    void assign(const T *first, u32 n) {
+        count = 0;
+        append(first, n);
+    }
+
+    void reserve(u32 wanted) {
+        if (wanted <= capacity) return;
+
+        u32 new_capacity = capacity ? capacity * 2 : 8;
+        if (new_capacity < wanted) new_capacity = wanted;
+
+        u64 extra = (u64)(new_capacity - capacity) * sizeof(T);
+
+        if (items && (u8 *)(items + capacity) == arena->cursor && (u64)(arena->limit - arena->cursor) >= extra) {
+            arena->cursor += extra;
+        } else {
+            auto grown = (T *)arena->allocate((u64)new_capacity * sizeof(T), alignof(T));
+            if (count) memcpy(grown, items, count * sizeof(T));
+            items = grown;
+        }
+
+        capacity = new_capacity;
+    }
+};
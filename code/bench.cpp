@@ -0,0 +1,247 @@
+// Micro benchmarks for the front end, built by compile.sh as build/bench.
+// usage: bench [megabytes of generated source, defaults to 16]
+
+#include <chrono>
+
+#include "unnamed.h"
+
+#include "arena.cpp"
+#include "lexer.cpp"
+#include "parser.cpp"
+#include "il.cpp"
+#include "il_analysis.cpp"
+#include "il_ssa.cpp"
+#include "il_gvn.cpp"
+#include "il_dce.cpp"
+#include "il_loops.cpp"
+#include "il_ranges.cpp"
+#include "il_strength.cpp"
+#include "il_calls.cpp"
+#include "il_inline.cpp"
+#include "il_passes.cpp"
+
+internal double get_seconds() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double>(now).count();
+}
+
+// Fills a buffer with words picked pseudo-randomly from the list,
+// eight words per line.
+internal char *generate_source(const char **words, u32 word_count, u64 size) {
+    auto source = (char *)malloc(size + 256); // room for the last word
+    char *cursor = source;
+    u32 seed = 12345;
+    u32 column = 0;
+
+    while ((u64)(cursor - source) < size) {
+        seed = seed * 1103515245 + 12345;
+        const char *word = words[(seed >> 16) % word_count];
+
+        u32 length = strlen(word);
+        memcpy(cursor, word, length);
+        cursor += length;
+
+        if (++column == 8) {
+            *cursor++ = '\n';
+            column = 0;
+        } else {
+            *cursor++ = ' ';
+        }
+    }
+
+    *cursor = '\0';
+    return source;
+}
+
+internal void bench_lexer(const char *name, char *source, u32 repeat, u32 thread_count = 1) {
+    u64 bytes = strlen(source);
+    u64 words = 0;
+    double best = 1e30;
+
+    for (u32 r = 0; r < repeat; r++) {
+        Lexer lexer(source);
+
+        double start = get_seconds();
+        lexer.tokenize_parallel(thread_count);
+        double elapsed = get_seconds() - start;
+
+        if (elapsed < best) best = elapsed;
+
+        words = 0;
+        for (auto type : lexer.token_types) {
+            if (type == Token::IDENTIFIER ||
+                (type >= Token::KEYWORD_START && type < Token::KEYWORD_END)) {
+                words++;
+            }
+        }
+    }
+
+    printf("lexer %-16s %2u threads %8.2f Mwords/s %8.2f MB/s  (%llu words, %.3f s)\n",
+           name,
+           thread_count,
+           words / best / 1e6,
+           bytes / best / (1024.0 * 1024.0),
+           (unsigned long long)words,
+           best);
+}
+
+// Generates small functions that look like first.un
+internal char *generate_functions(u64 size) {
+    auto source = (char *)malloc(size + 512);
+    char *cursor = source;
+    u32 i = 0;
+
+    while ((u64)(cursor - source) < size) {
+        cursor += sprintf(cursor,
+            "func f%u(a : i32, b : i32) -> i32 {\n"
+            "    // keep going until it's big enough\n"
+            "    c : i32 = a + b * 3;\n"
+            "    while c < 1000 {\n"
+            "        c = c + a - (b * 2);\n"
+            "        a = -a;\n"
+            "    }\n"
+            "    return c;\n"
+            "}\n\n", i++);
+    }
+
+    *cursor = '\0';
+    return source;
+}
+
+internal void bench_parser(char *source, u32 repeat, u32 thread_count = 1) {
+    u64 tokens = 0;
+    double best = 1e30;
+
+    for (u32 r = 0; r < repeat; r++) {
+        Lexer lexer(source);
+        lexer.tokenize();
+        tokens = lexer.token_types.size();
+
+        Arena arena;
+        AST::Parser parser;
+
+        double start = get_seconds();
+        parser.parse_module(&lexer, &arena, thread_count);
+        double elapsed = get_seconds() - start;
+
+        if (elapsed < best) best = elapsed;
+    }
+
+    printf("parser %-15s %2u threads %8.2f Mtokens/s (%llu tokens, %.3f s)\n",
+           "functions",
+           thread_count,
+           tokens / best / 1e6,
+           (unsigned long long)tokens,
+           best);
+}
+
+// One function returning an expression nested depth levels deep, either
+// right-nested parentheses, 1 + (1 + (... + (1))), or a chain of prefix minuses
+internal char *generate_deep_expression(u32 depth, bool unary) {
+    auto source = (char *)malloc(depth * 6 + 256);
+    char *cursor = source;
+
+    cursor += sprintf(cursor, "func f(a : i32) -> i32 {\n    return ");
+
+    for (u32 i = 1; i < depth; i++) {
+        if (unary) {
+            *cursor++ = '-';
+            *cursor++ = ' ';
+        } else {
+            memcpy(cursor, "1 + (", 5);
+            cursor += 5;
+        }
+    }
+
+    *cursor++ = '1';
+
+    if (!unary) {
+        for (u32 i = 1; i < depth; i++) *cursor++ = ')';
+    }
+
+    cursor += sprintf(cursor, ";\n}\n");
+    *cursor = '\0';
+    return source;
+}
+
+internal void bench_expression_depth(u32 depth, bool unary) {
+    char *source = generate_deep_expression(depth, unary);
+
+    Lexer lexer(source);
+    lexer.tokenize();
+
+    Arena arena;
+    AST::Parser parser;
+
+    double start = get_seconds();
+    auto module_ast = parser.parse_module(&lexer, &arena);
+    double parsed = get_seconds();
+    IL::convert_module(module_ast, &arena);
+    double converted = get_seconds();
+
+    printf("expression %-6s depth %8u  parse %9.3f ms  IL %9.3f ms  %6.1f ns/level\n",
+           unary ? "unary" : "nested",
+           depth,
+           (parsed - start) * 1e3,
+           (converted - parsed) * 1e3,
+           (converted - start) * 1e9 / depth);
+}
+
+int main(i32 argc, char **argv) {
+    u64 megabytes = 16;
+    if (argc > 1) megabytes = strtoul(argv[1], nullptr, 10);
+
+    u64 size = megabytes * 1024 * 1024;
+    u32 repeat = 3;
+
+    // @note: sources are never freed, atom_table points into them.
+
+    const char *keyword_words[] = {
+        "while", "func", "i8", "i16", "i32", "i64", "void", "return", "cast",
+    };
+
+    const char *identifier_words[] = {
+        "a", "b", "counter", "table_size", "whilex", "functor", "i8x", "voidp",
+        "returned", "casting", "putint", "argc", "hash_index", "_tmp0",
+    };
+
+    const char *commented_words[] = {
+        "\n    // a comment line that is about as long as the ones we generate\n",
+        "\n        ", "counter", "=", "counter_next", "+", "1", ";",
+    };
+
+    char *keyword_source = generate_source(keyword_words,
+            sizeof(keyword_words) / sizeof(keyword_words[0]), size);
+    bench_lexer("keyword-heavy", keyword_source, repeat);
+
+    char *identifier_source = generate_source(identifier_words,
+            sizeof(identifier_words) / sizeof(identifier_words[0]), size);
+    bench_lexer("identifier-heavy", identifier_source, repeat);
+
+    u32 core_count = resolve_thread_count(0);
+    for (u32 thread_count = 2; thread_count <= core_count; thread_count *= 2) {
+        bench_lexer("identifier-heavy", identifier_source, repeat, thread_count);
+    }
+
+    char *commented_source = generate_source(commented_words,
+            sizeof(commented_words) / sizeof(commented_words[0]), size);
+    bench_lexer("commented", commented_source, repeat);
+
+    char *function_source = generate_functions(size / 4);
+    bench_parser(function_source, repeat);
+
+    for (u32 thread_count = 2; thread_count <= core_count; thread_count *= 2) {
+        bench_parser(function_source, repeat, thread_count);
+    }
+
+    // should stay flat per level, and not crash at the deep end
+    for (u32 depth = 10; depth <= 1000000; depth *= 10) {
+        bench_expression_depth(depth, false);
+    }
+
+    for (u32 depth = 10; depth <= 1000000; depth *= 10) {
+        bench_expression_depth(depth, true);
+    }
+
+    return 0;
+}
@@ -8,6 +8,12 @@ struct Compiler_Options {
     // defaults to 0.
     // can be 0, 1, 2, 3.
     u32 optimization_level;
+
+    // threads to use for the front end, 0 means one per core.
+    u32 thread_count;
+
+    // print what the IL passes did to each function, to stderr.
+    bool print_statistics;
 };
 
 static Compiler_Options options = {};
@@ -2,222 +2,533 @@
 
 namespace IL {
 
+    Value_Id Function::insert(u32 bb, Value value) {
+        analyses.valid = 0;
+
+        Value_Id n = values.size();
+        values.push_back(value);
+        blocks[bb].instructions.push_back(n);
+
+        return n;
+    }
+
     // @FIXME: do we really need to insert constants into basic blocks?
-    Constant *Function::insert_constant(Basic_Block *bb, u64 value) {
-        auto c = new Constant;
-        c->n = value_count++;
-        c->value = value;
-        bb->instructions.push_back(c);
+    Value_Id Function::insert_constant(u32 bb, u64 value, AST::Type *type) {
+        Value v;
+        v.type = Value::CONSTANT;
+        v.value_type = type;
+        v.constant.value = value;
 
-        return c;
+        return insert(bb, v);
     }
 
-    Alloca *Function::insert_alloca(Basic_Block *bb, u32 size) {
-        auto alloca = new Alloca;
-        alloca->n    = value_count++;
-        alloca->size = size;
-        bb->instructions.push_back(alloca);
+    Value_Id Function::insert_alloca(u32 bb, AST::Type *type) {
+        Value v;
+        v.type = Value::ALLOCA;
+        v.value_type = type;
+        v.alloca.size = ((AST::Integer_Type *)type)->size;
 
-        return alloca;
+        return insert(bb, v);
     }
 
-    Binary_Expression *Function::insert_binary(Basic_Block *bb, u32 op, Value *lhs, Value *rhs) {
-        auto bi = new Binary_Expression;
-        bi->n  = value_count++;
-        bi->op  = op;
-        bi->lhs = lhs;
-        bi->rhs = rhs;
-        bb->instructions.push_back(bi);
+    Value_Id Function::insert_binary(u32 bb, u32 op, Value_Id lhs, Value_Id rhs, AST::Type *type) {
+        Value v;
+        v.type = Value::BINARY_EXPRESSION;
+        v.value_type = type;
+        v.binary.op    = op;
+        v.binary.lhs   = lhs;
+        v.binary.rhs   = rhs;
+        v.binary.flags = 0;
 
-        return bi;
+        return insert(bb, v);
     }
 
-    Unary_Expression *Function::insert_unary(Basic_Block *bb, u32 op, Value *operand) {
-        auto un = new Unary_Expression;
-        un->n  = value_count++;
-        un->op = op;
-        un->operand = operand;
-        bb->instructions.push_back(un);
+    Value_Id Function::insert_unary(u32 bb, u32 op, Value_Id operand, AST::Type *type) {
+        Value v;
+        v.type = Value::UNARY_EXPRESSION;
+        v.value_type = type;
+        v.unary.op      = op;
+        v.unary.operand = operand;
 
-        return un;
+        return insert(bb, v);
     }
 
-    // @note: remember to fill in the arguments
-    // @TODO: note that we constructed arguements twice, which is stupid
-    Function_Call *Function::insert_call(Basic_Block *bb, char *name, Array<Value *> *arguments) {
-        auto call  = new Function_Call;
-        call->n    = value_count++;
-        call->name = name;
+    Value_Id Function::insert_call(u32 bb, u32 callee, Value_Id *call_arguments, u32 argument_count, AST::Type *type) {
+        Value v;
+        v.type = Value::FUNCTION_CALL;
+        v.value_type = type;
+        v.call.callee = callee;
+        v.call.first_argument = arguments.size();
+        v.call.argument_count = argument_count;
 
-        for (auto arg : *arguments) {
-            call->arguments.push_back(arg);
-        }
+        arguments.insert(arguments.end(), call_arguments, call_arguments + argument_count);
+
+        return insert(bb, v);
+    }
 
-        bb->instructions.push_back(call);
+    Value_Id Function::insert_load(u32 bb, Value_Id base, Value_Id offset) {
+        Value v;
+        v.type = Value::LOAD;
+        v.value_type = values[base].value_type;
+        v.load.base   = base;
+        v.load.offset = offset;
 
-        return call;
+        return insert(bb, v);
     }
 
-    Load *Function::insert_load(Basic_Block *bb, Value *base, Value *offset) {
-        auto load    = new Load;
-        load->n      = value_count++;
-        load->base   = base;
-        load->offset = offset;
-        bb->instructions.push_back(load);
+    Value_Id Function::insert_store(u32 bb, Value_Id source, Value_Id base, Value_Id offset) {
+        Value v;
+        v.type = Value::STORE;
+        v.store.source = source;
+        v.store.base   = base;
+        v.store.offset = offset;
 
-        return load;
+        return insert(bb, v);
     }
 
-    Store *Function::insert_store(Basic_Block *bb, Value *source, Value *base, Value *offset) {
-        auto store    = new Store;
-        store->n      = value_count++;
-        store->source = source;
-        store->base   = base;
-        store->offset = offset;
-        bb->instructions.push_back(store);
+    Value_Id Function::insert_branch(u32 bb, Value_Id condition, u32 true_target, u32 false_target) {
+        Value v;
+        v.type = Value::BRANCH;
+        v.branch.condition    = condition;
+        v.branch.true_target  = true_target;
+        v.branch.false_target = false_target;
 
-        return store;
+        return insert(bb, v);
     }
 
-    Branch *Function::insert_branch(Basic_Block *bb, Value *condition, Basic_Block *true_target, Basic_Block *false_target) {
-        auto br          = new Branch;
-        br->n            = value_count++;
-        br->condition    = condition;
-        br->true_target  = true_target;
-        br->false_target = false_target;
-        bb->instructions.push_back(br);
+    Value_Id Function::insert_jump(u32 bb, u32 target) {
+        Value v;
+        v.type = Value::JUMP;
+        v.jump.target = target;
 
-        return br;
+        return insert(bb, v);
     }
 
-    Jump *Function::insert_jump(Basic_Block *bb, Basic_Block *target) {
-        auto jmp    = new Jump;
-        jmp->n      = value_count++;
-        jmp->target = target;
-        bb->instructions.push_back(jmp);
+    Value_Id Function::insert_return(u32 bb, Value_Id return_value) {
+        Value v;
+        v.type = Value::RETURN;
+        v.ret.return_value = return_value;
 
-        return jmp;
+        return insert(bb, v);
     }
 
-    Return *Function::insert_return(Basic_Block *bb, Value *return_value) {
-        auto ret          = new Return;
-        ret->n            = value_count++;
-        ret->return_value = return_value;
-        bb->instructions.push_back(ret);
+    Value_Id Function::insert_argument(u32 bb, u32 index, AST::Type *type) {
+        Value v;
+        v.type = Value::ARGUMENT;
+        v.value_type = type;
+        v.argument.index = index;
 
-        return ret;
+        return insert(bb, v);
     }
 
+    // The types of IL values are all integers, see Value::value_type
+    inline u32  type_bits(AST::Type *type)        { return ((AST::Integer_Type *)type)->size * 8; }
+    inline bool is_unsigned_type(AST::Type *type) { return ((AST::Integer_Type *)type)->is_unsigned; }
+
+    // Constants keep their bits zero-extended to 64, whatever their width
+    inline u64 truncate_bits(u64 value, u32 bits) {
+        return (bits == 64) ? value : value & ((1ull << bits) - 1);
+    }
+
+    inline i64 sign_extend_bits(u64 value, u32 bits) {
+        return (bits == 64) ? (i64)value : (i64)(value << (64 - bits)) >> (64 - bits);
+    }
+
+    inline bool is_compare(u32 op) {
+        return op == '<' || op == Binary_Expression::UNSIGNED_LESS;
+    }
+
+    // An expression node waiting on the work stack of convert_expression
+    struct Expression_Work {
+        AST::Handle expr;
+        bool operands_done; // its operands' values are on the value stack
+    };
+
     struct Convert_Context {
+        Arena *arena;
         Function *f;
-        Basic_Block *bb;
+        u32 bb;
         AST::Scope *scope;
+        AST::Node_Pool *nodes; // of the function being converted
+        Pass_Manager *passes = nullptr; // run on each function once it's converted
+
+        // index in the module of each function, by atom id of its name, so
+        // calls are resolved once, here. See index_functions
+        Array<u32> function_of;
+        AST::Module *module_ast;
+
+        // scratch for convert_expression, kept to reuse the memory
+        Array<Expression_Work> work;
+        Array<Value_Id> values;
+        Array<AST::Type *> types; // of each of values, see give_type
+        Array<Value_Id> untyped;
     };
 
-    internal Value *convert_expression(Convert_Context *ctx, AST::Expreesion *expr, bool is_lvalue = false) {
-        switch (expr->type) {
+    // Every function is declared once the parser's first pass is done, and
+    // the atoms of their names exist by then. Bodies parsed later may add
+    // atoms, but not ones that name functions.
+    internal void index_functions(Convert_Context *ctx, AST::Module *module_ast) {
+        ctx->module_ast = module_ast;
+        ctx->function_of.assign(atom_table.names.size(), ~0u);
 
-            case AST::INT_LITERAL: {
-                auto lit = (AST::Int_Literal *) expr;
-                // @TODO: reuse previously created constant if values are the same
-                return ctx->f->insert_constant(ctx->bb, lit->value);
-            }
+        for (auto function_ast : module_ast->functions) {
+            ctx->function_of[function_ast->name.id] = function_ast->index;
+        }
+    }
 
-            case AST::IDENTIFIER: {
-                auto id = (AST::Identifier *) expr;
+    /* @note
+     * Integer literals have no type of their own. A literal, or an
+     * expression of nothing but literals, is left without one (value_type
+     * nullptr) until it meets a value that has one, or something that needs
+     * one, and give_type gives it that: 1 in x + 1 is whatever x is. When
+     * nothing says, it's the type of its biggest literal, see
+     * natural_type. Everything else gets its type as it's converted.
+     *
+     * Until then an untyped constant holds an i64. Operators on nothing but
+     * literals are folded as they're converted (see fold_literals), so -200
+     * or 1000 * 1000 is one constant whose value can be checked against the
+     * type it meets. Literals past INT64_MAX are u64 from the start.
+     */
+    internal void give_type(Convert_Context *ctx, Value_Id root, AST::Type *type) {
+        auto f = ctx->f;
+        auto &untyped = ctx->untyped;
+
+        untyped.push_back(root);
+
+        while (untyped.size()) {
+            auto v = f->value(untyped.back());
+            untyped.pop_back();
+
+            if (v->value_type) continue;
+            v->value_type = type;
+
+            if (auto c = v->as<Constant>()) c->value = truncate_bits(c->value, type_bits(type));
+            else f->for_each_operand(v, [&](Value_Id &operand) { untyped.push_back(operand); });
+        }
+    }
 
-                // @TODO: handle global variable
-                // @performance
-                auto var = find_variable(ctx->scope, id->name);
-                assert(var->address);
+    // i32 if the untyped value fits in one, i64 if not, like in C
+    internal AST::Type *literal_type(Convert_Context *ctx, i64 value) {
+        auto types = ctx->module_ast->types;
 
-                if (is_lvalue) {
-                    return var->address;
-                } else {
-                    return ctx->f->insert_load(ctx->bb, var->address);
-                }
-            }
+        if (value >= INT32_MIN && value <= INT32_MAX) return types->integer_type(4);
+        return types->integer_type(8);
+    }
 
-            case AST::BINARY: {
-                auto bi = (AST::Binary *) expr;
+    internal bool literal_fits(i64 value, AST::Type *type) {
+        u32 bits = type_bits(type);
 
-                // @TODO:
-                // can we do the iterative version of this?
-                // because recursion might blow up the stack!
-                auto lhs = convert_expression(ctx, bi->lhs);
-                auto rhs = convert_expression(ctx, bi->rhs);
+        if (is_unsigned_type(type)) return value >= 0 && (u64)value <= truncate_bits(~0ull, bits);
+        return value == sign_extend_bits(truncate_bits((u64)value, bits), bits);
+    }
 
-                auto bi_value = ctx->f->insert_binary(ctx->bb, bi->op, lhs, rhs);
+    // lhs op rhs for two untyped constants, wrapping at 64 bits. Division
+    // by zero is left for run time, like fold_binary leaves it.
+    internal bool fold_literals(u32 op, i64 lhs, i64 rhs, i64 *result) {
+        switch (op) {
+            case '+': *result = (i64)((u64)lhs + (u64)rhs); return true;
+            case '-': *result = (i64)((u64)lhs - (u64)rhs); return true;
+            case '*': *result = (i64)((u64)lhs * (u64)rhs); return true;
+        }
 
-                return bi_value;
+        if (op != '/' && op != '%') return false;
+        if (rhs == 0 || (lhs == INT64_MIN && rhs == -1)) return false;
 
-            }
+        *result = (op == '/') ? lhs / rhs : lhs % rhs;
+        return true;
+    }
+
+    /* @note
+     * What both sides of a binary operator are converted to: the wider
+     * type, or the unsigned one if they're the same size. That's C's usual
+     * arithmetic conversions without the integer promotions: nothing is
+     * widened to i32 first, so arithmetic on two i8s happens in 8 bits and
+     * a + a is -56 for an i8 a of 100, where C gives 200.
+     */
+    internal AST::Type *common_type(AST::Type *a, AST::Type *b) {
+        if (type_bits(a) != type_bits(b)) return (type_bits(a) > type_bits(b)) ? a : b;
+        return is_unsigned_type(a) ? a : b;
+    }
 
-            case AST::UNARY: {
-                auto un = (AST::Unary *) expr;
+    internal AST::Type *natural_type(Convert_Context *ctx, Value_Id root) {
+        auto f = ctx->f;
+        auto &untyped = ctx->untyped;
 
-                // @TODO: see the todo above
-                auto operand = convert_expression(ctx, un->operand);
+        auto type = literal_type(ctx, 0);
+        untyped.push_back(root);
 
-                auto un_value = ctx->f->insert_unary(ctx->bb, un->op, operand);
+        while (untyped.size()) {
+            auto v = f->value(untyped.back());
+            untyped.pop_back();
 
-                return un_value;
+            if (v->value_type) continue;
 
-            }
+            if (auto c = v->as<Constant>()) type = common_type(type, literal_type(ctx, (i64)c->value));
+            else f->for_each_operand(v, [&](Value_Id &operand) { untyped.push_back(operand); });
+        }
 
-            case AST::FUNCTION_CALL: {
-                auto call_ast = (AST::Function_Call *) expr;
+        return type;
+    }
 
-                Array<Value *> arguments;
+    // n as a value of type to. Extending goes by the signedness of what's
+    // extended, and the same size needs nothing, like in C.
+    internal Value_Id convert_to(Convert_Context *ctx, Value_Id n, AST::Type *to) {
+        auto from = ctx->f->value(n)->value_type;
 
-                for (auto arg_expr : call_ast->arguments) {
-                    auto arg_value = convert_expression(ctx, arg_expr);
-                    arguments.push_back(arg_value);
-                }
+        if (!from) {
+            give_type(ctx, n, to);
+            return n;
+        }
 
-                auto call = ctx->f->insert_call(ctx->bb, call_ast->name, &arguments);
+        assert(from->type == AST::Type::INTEGER && "using the value of a void function");
+        assert(to->type == AST::Type::INTEGER && "converting to void");
 
-                return call;
+        u32 from_bits = type_bits(from), to_bits = type_bits(to);
+        if (from_bits == to_bits) return n;
 
-            }
+        u32 op;
+        if (to_bits < from_bits)          op = Unary_Expression::TRUNCATE;
+        else if (is_unsigned_type(from))  op = Unary_Expression::ZERO_EXTEND;
+        else                              op = Unary_Expression::SIGN_EXTEND;
 
-            default: {
-                assert(false && "Interal Compiler Error: converting unknown expreesion to intermediate language");
-                return nullptr;
-            }
+        return ctx->f->insert_unary(ctx->bb, op, n, to);
+    }
+
+    // The address of the variable assigned to
+    internal Value_Id convert_lvalue(Convert_Context *ctx, AST::Handle expr) {
+        assert(AST::handle_kind(expr) == AST::IDENTIFIER && "can only assign to variables");
+
+        // @TODO: handle global variable
+        auto var = find_variable(ctx->scope, ctx->nodes->identifier(expr));
+        assert(var->address != no_value);
+
+        return var->address;
+    }
+
+    /* @note
+     * Expressions are converted in post order with an explicit work stack
+     * instead of recursion, so deep generated expressions can't overflow
+     * the stack. A node is visited twice: the first time it queues its
+     * operands (left to right, same order as before), the second time their
+     * values are on top of the value stack and it emits its instruction.
+     *
+     * The value is converted to type to, if there is one. This is where the
+     * source is type checked too: the types of the operands decide the type
+     * of each operation, and they're converted to it where they differ.
+     */
+    internal Value_Id convert_expression(Convert_Context *ctx, AST::Handle expr, AST::Type *to = nullptr) {
+        auto nodes = ctx->nodes;
+        auto f     = ctx->f;
+
+        auto &work   = ctx->work;
+        auto &values = ctx->values;
+        auto &types  = ctx->types;
+
+        u32 work_base  = work.size();
+        u32 value_base = values.size();
+
+        work.push_back({expr, false});
+
+        while (work.size() > work_base) {
+            auto item = work.back();
+            work.pop_back();
+
+            switch (AST::handle_kind(item.expr)) {
+
+                case AST::INT_LITERAL: {
+                    u64 value = nodes->int_literal(item.expr);
+                    auto type = (value > INT64_MAX) ? ctx->module_ast->types->integer_type(8, true) : nullptr;
+
+                    // duplicates are merged by number_values
+                    values.push_back(f->insert_constant(ctx->bb, value, type));
+                    types.push_back(type);
+                } break;
+
+                case AST::IDENTIFIER: {
+                    // @TODO: handle global variable
+                    // @performance
+                    auto var = find_variable(ctx->scope, nodes->identifier(item.expr));
+                    assert(var->address != no_value);
+
+                    values.push_back(f->insert_load(ctx->bb, var->address));
+                    types.push_back(var->var_type);
+                } break;
+
+                case AST::BINARY: {
+                    auto bi = nodes->binary(item.expr);
+
+                    if (!item.operands_done) {
+                        work.push_back({item.expr, true});
+                        work.push_back({bi.rhs, false});
+                        work.push_back({bi.lhs, false});
+                        break;
+                    }
+
+                    auto rhs = values.back(); values.pop_back();
+                    auto lhs = values.back(); values.pop_back();
+
+                    auto rhs_type = types.back(); types.pop_back();
+                    auto lhs_type = types.back(); types.pop_back();
+
+                    // of the operands, nullptr while it's all literals
+                    AST::Type *type;
+
+                    if (lhs_type && rhs_type) {
+                        type = common_type(lhs_type, rhs_type);
+                    } else if (lhs_type || rhs_type) {
+                        type = lhs_type ? lhs_type : rhs_type;
+
+                        // a literal that doesn't fit the other side widens it
+                        // instead: x < 300 or x < -1 for a u8 x
+                        auto c = f->value(lhs_type ? rhs : lhs)->as<Constant>();
+                        if (c && !literal_fits((i64)c->value, type)) type = common_type(type, literal_type(ctx, (i64)c->value));
+                    } else if (bi.op == '<') {
+                        type = common_type(natural_type(ctx, lhs), natural_type(ctx, rhs));
+                    } else {
+                        type = nullptr;
+
+                        // folded into lhs, rhs is left for dead code elimination
+                        auto lhs_constant = f->value(lhs)->as<Constant>();
+                        auto rhs_constant = f->value(rhs)->as<Constant>();
+                        i64 folded;
+
+                        if (lhs_constant && rhs_constant &&
+                            fold_literals(bi.op, (i64)lhs_constant->value, (i64)rhs_constant->value, &folded)) {
+                            lhs_constant->value = (u64)folded;
+                            values.push_back(lhs);
+                            types.push_back(nullptr);
+                            break;
+                        }
+                    }
+
+                    u32 op = bi.op;
+
+                    if (type) {
+                        lhs = convert_to(ctx, lhs, type);
+                        rhs = convert_to(ctx, rhs, type);
+
+                        if (is_unsigned_type(type) && op == '/') op = Binary_Expression::UNSIGNED_DIV;
+                        if (is_unsigned_type(type) && op == '%') op = Binary_Expression::UNSIGNED_MOD;
+                        if (is_unsigned_type(type) && op == '<') op = Binary_Expression::UNSIGNED_LESS;
+                    }
+
+                    if (is_compare(op)) type = ctx->module_ast->types->integer_type(4); // 0 or 1
+
+                    values.push_back(f->insert_binary(ctx->bb, op, lhs, rhs, type));
+                    types.push_back(type);
+                } break;
+
+                case AST::UNARY: {
+                    auto un = nodes->unary(item.expr);
+
+                    if (!item.operands_done) {
+                        work.push_back({item.expr, true});
+                        work.push_back({un.operand, false});
+                        break;
+                    }
+
+                    auto operand = values.back(); values.pop_back();
+
+                    // a negative literal is one constant, see give_type
+                    auto c = f->value(operand)->as<Constant>();
+                    if (c && !types.back() && (un.op == '-' || un.op == '+')) {
+                        if (un.op == '-') c->value = 0 - c->value;
+                        values.push_back(operand);
+                        break;
+                    }
+
+                    values.push_back(f->insert_unary(ctx->bb, un.op, operand, types.back()));
+                    // its type stays on the stack
+                } break;
+
+                case AST::FUNCTION_CALL: {
+                    auto call_ast = nodes->call(item.expr);
+                    auto args = nodes->arguments(call_ast);
+
+                    if (!item.operands_done) {
+                        work.push_back({item.expr, true});
+                        for (u32 i = args.size(); i > 0; i--) {
+                            work.push_back({args[i-1], false});
+                        }
+                        break;
+                    }
+
+                    u32 callee = (call_ast.name.id < ctx->function_of.size()) ? ctx->function_of[call_ast.name.id] : ~0u;
+                    assert(callee != ~0u && "call to an undeclared function");
+
+                    auto callee_type = ctx->module_ast->functions[callee]->func_type;
+                    assert(callee_type->arguments.size() == args.size() && "wrong number of arguments");
 
+                    u32 first = values.size() - args.size();
+                    for (u32 i = 0; i < args.size(); i++) {
+                        values[first + i] = convert_to(ctx, values[first + i], callee_type->arguments[i]);
+                    }
+
+                    auto call = f->insert_call(ctx->bb, callee, values.data() + first, args.size(), callee_type->return_type);
+                    values.resize(first);
+                    types.resize(first);
+
+                    values.push_back(call);
+                    types.push_back(callee_type->return_type);
+                } break;
+
+                default: {
+                    assert(false && "Interal Compiler Error: converting unknown expreesion to intermediate language");
+                    return no_value;
+                }
+
+            }
         }
+
+        assert(values.size() == value_base + 1);
+
+        auto value = values.back();
+        auto type  = types.back();
+        values.pop_back();
+        types.pop_back();
+
+        if (to)         value = convert_to(ctx, value, to);
+        else if (!type) give_type(ctx, value, natural_type(ctx, value));
+
+        return value;
     }
 
-    internal void convert_block(Convert_Context *ctx, AST::Block *block_ast) {
+    // Returns true if the block returns, so control never reaches its end.
+    internal bool convert_block(Convert_Context *ctx, AST::Handle block_handle) {
+        auto nodes = ctx->nodes;
+        auto block_ast = nodes->block(block_handle);
 
         auto old_scope = ctx->scope;
-        ctx->scope = block_ast->scope;
+        ctx->scope = block_ast.scope;
+
+        bool returns = false;
 
         // @curious
         // How does this way of dynamic dispatching affters I$?
         // How can we profile it?
-        for (auto stmt : block_ast->statements) {
+        for (auto stmt : nodes->statements(block_ast)) {
+
+            // nothing after a return runs, don't bother converting it
+            if (returns) break;
 
-            switch (stmt->type) {
+            switch (AST::handle_kind(stmt)) {
 
                 case AST::INT_LITERAL:
                 case AST::IDENTIFIER:
                 case AST::BINARY:
                 case AST::UNARY:
                 case AST::FUNCTION_CALL:
-                    convert_expression(ctx, (AST::Expreesion *)stmt);
+                    convert_expression(ctx, stmt);
                     break;
 
                 case AST::VARIABLE: {
-                    auto var = (AST::Variable *) stmt;
+                    auto var = nodes->variable(stmt);
 
-                    // @TODO: allocate depending on size of the type
-                    assert(var->address == nullptr);
-                    auto alloca = ctx->f->insert_alloca(ctx->bb, 4);
+                    assert(var->address == no_value);
+                    auto alloca = ctx->f->insert_alloca(ctx->bb, var->var_type);
 
-                    if (var->initial_value) {
-                        auto initial_value = convert_expression(ctx, var->initial_value);
+                    if (var->initial_value != AST::no_node) {
+                        auto initial_value = convert_expression(ctx, var->initial_value, var->var_type);
                         ctx->f->insert_store(ctx->bb, initial_value, alloca);
                     }
 
@@ -225,32 +536,31 @@ namespace IL {
                 } break;
 
                 case AST::ASSIGN: {
-                    auto assign = (AST::Assign *) stmt;
+                    auto assign = nodes->assign(stmt);
 
-                    auto source = convert_expression(ctx, assign->rhs);
-                    auto dest   = convert_expression(ctx, assign->lhs, true);
+                    auto dest   = convert_lvalue(ctx, assign.lhs);
+                    auto source = convert_expression(ctx, assign.rhs, ctx->f->value(dest)->value_type);
 
                     ctx->f->insert_store(ctx->bb, source, dest);
 
                 } break;
 
                 case AST::WHILE: {
-                    auto wh = (AST::While *) stmt;
+                    auto wh = nodes->while_loop(stmt);
 
                     // @TODO: insert into blocks
                     auto header = ctx->f->insert_block();
                     ctx->f->insert_jump(ctx->bb, header);
 
                     ctx->bb = header;
-                    auto cond = convert_expression(ctx, wh->condition);
+                    auto cond = convert_expression(ctx, wh.condition);
 
                     auto body = ctx->f->insert_block();
                     ctx->bb = body;
-                    convert_block(ctx, wh->body);
-                    ctx->f->insert_jump(ctx->bb, header);
+                    if (!convert_block(ctx, wh.body)) {
+                        ctx->f->insert_jump(ctx->bb, header);
+                    }
 
-                    // @TODO: take care of the case if we have return in
-                    // the loop
                     auto out = ctx->f->insert_block();
                     ctx->bb = out;
 
@@ -259,27 +569,23 @@ namespace IL {
                 } break;
 
                 case AST::RETURN: {
-                    auto ret_ast = (AST::Return *) stmt;
+                    auto ret_ast = nodes->ret(stmt);
 
-                    Value *return_value = nullptr;
-                    if (ret_ast->return_value) {
-                        return_value = convert_expression(ctx, ret_ast->return_value);
+                    Value_Id return_value = no_value;
+                    if (ret_ast.return_value != AST::no_node) {
+                        auto return_type = ctx->f->ast->func_type->return_type;
+                        return_value = convert_expression(ctx, ret_ast.return_value, return_type);
                     }
 
                     ctx->f->insert_return(ctx->bb, return_value);
-
-                    // @TODO: halt conversion of the statements that follows
+                    returns = true;
 
                 } break;
 
                 case AST::BLOCK: {
-                    auto block_ast = (AST::Block *) stmt;
-
-                    convert_block(ctx, block_ast);
+                    returns = convert_block(ctx, stmt);
 
-                    // @TODO: handle return in block
-
-                }
+                } break;
 
                 default: {
                     assert(false && "Interal Compiler Error: converting unknown statement to intermidiate language.");
@@ -290,48 +596,87 @@ namespace IL {
 
         ctx->scope = old_scope;
 
+        return returns;
     }
 
     internal Function *convert_function(Convert_Context *ctx, AST::Function *func_ast) {
 
-        auto f = new Function;
+        auto f = ctx->arena->make<Function>();
         f->ast = func_ast;
 
-        if (func_ast->body == nullptr) return f;
+        if (func_ast->body == AST::no_node) return f;
+
+        // every value comes from at least one token, usually more, so this
+        // is a little generous but saves regrowing the array in big functions
+        f->values.reserve(func_ast->body_token_count);
 
-        auto entry_block = new Basic_Block;
-        f->blocks.push_back(entry_block);
+        ctx->f     = f;
+        ctx->bb    = f->insert_block(); // entry
+        ctx->nodes = func_ast->nodes;
+
+        // arguments are variables like any other, promote_allocas takes
+        // them back out of memory
+        for (u32 i = 0; i < func_ast->arguments.size(); i++) {
+            auto var = func_ast->arguments[i];
+            assert(var->address == no_value);
+
+            auto argument = f->insert_argument(ctx->bb, i, var->var_type);
+            auto alloca   = f->insert_alloca(ctx->bb, var->var_type);
+            f->insert_store(ctx->bb, argument, alloca);
+
+            var->address = alloca;
+        }
+
+        bool returns = convert_block(ctx, func_ast->body);
+
+        // void functions may just end
+        if (!returns && func_ast->func_type->return_type->type == AST::Type::VOID) {
+            f->insert_return(ctx->bb);
+        }
 
-        ctx->bb = entry_block;
-        ctx->f  = f;
-        convert_block(ctx, func_ast->body);
+        if (ctx->passes) run_function_passes(ctx->passes, f);
 
         return f;
 
     }
     
-    internal Module *convert_module(AST::Module *module_ast) {
-        auto m = new Module;
+    internal Module *convert_module(AST::Module *module_ast, Arena *arena, Pass_Manager *passes = nullptr) {
+        auto m = arena->make<Module>();
 
         Convert_Context ctx;
-        ctx.scope = module_ast->scope;
+        ctx.arena  = arena;
+        ctx.scope  = module_ast->scope;
+        ctx.passes = passes;
+        index_functions(&ctx, module_ast);
 
-        // @TODO: get rid of std thing
-        m->globals = std::move(module_ast->scope->variables);
+        m->globals.assign(module_ast->scope->variables.begin(), module_ast->scope->variables.end());
 
         for (auto function_ast : module_ast->functions) {
             auto f = convert_function(&ctx, function_ast);
             m->functions.push_back(f);
         }
 
+        if (passes) run_module_passes(passes, m);
+
         return m;
 
     }
 
 };
 
-inline void print_value(IL::Value *v) {
-    printf("$%u", v->n);
+inline void print_value(IL::Value_Id n) {
+    printf("$%u", n);
+}
+
+internal void print_type(AST::Type *type) {
+    if (type->type == AST::Type::VOID) {
+        printf("void");
+    } else if (type->type == AST::Type::INTEGER) {
+        auto int_type = (AST::Integer_Type *)type;
+        printf("%c%u", int_type->is_unsigned ? 'u' : 'i', int_type->size * 8);
+    } else {
+        printf("func");
+    }
 }
 
 internal void print_il_module(IL::Module *module) {
@@ -342,17 +687,21 @@ internal void print_il_module(IL::Module *module) {
          func_index++) {
 
         auto function = module->functions[func_index];
-        printf("%s:\n", function->ast->name);
+        if (function->removed) continue;
+
+        String function_name = atom_table.name(function->ast->name);
+        printf("%.*s:\n", (int)function_name.length, function_name.data);
 
         for (u32 bb_index = 0;
              bb_index < function->blocks.size();
              bb_index++) {
 
-            auto bb = function->blocks[bb_index];
+            auto &bb = function->blocks[bb_index];
             printf(".L%u_%u:\n", func_index, bb_index);
 
-            for (auto I : bb->instructions) {
-                printf("\t$%-3u ", I->n);
+            for (auto n : bb.instructions) {
+                auto I = function->value(n);
+                printf("\t$%-3u ", n);
                 if (auto c = I->as<Constant>()) {
                     printf("const\t%llu", c->value);
                 } else if (auto alloca = I->as<Alloca>()) {
@@ -364,34 +713,53 @@ internal void print_il_module(IL::Module *module) {
                         case '+': op = "+"; break;
                         case '-': op = "-"; break;
                         case '/': op = "/"; break;
+                        case '%': op = "%"; break;
                         case '*': op = "*"; break;
+                        case '&': op = "&"; break;
                         case '<': op = "<"; break;
+                        case Binary_Expression::UNSIGNED_DIV:           op = "u/";  break;
+                        case Binary_Expression::UNSIGNED_MOD:           op = "u%";  break;
+                        case Binary_Expression::SHIFT_LEFT:             op = "<<";  break;
+                        case Binary_Expression::SHIFT_RIGHT:            op = ">>";  break;
+                        case Binary_Expression::UNSIGNED_SHIFT_RIGHT:   op = "u>>"; break;
+                        case Binary_Expression::MULTIPLY_HIGH:          op = "*hi"; break;
+                        case Binary_Expression::UNSIGNED_MULTIPLY_HIGH: op = "u*hi"; break;
+                        case Binary_Expression::UNSIGNED_LESS:          op = "u<";  break;
                         default: assert(false && "Interal Compiler Error: printing unknown binary operator");
                     }
                     print_value(bi->lhs);
                     printf(" %s ", op);
                     print_value(bi->rhs);
+
+                    if (bi->flags & Binary_Expression::NO_SIGNED_WRAP)   printf(" nsw");
+                    if (bi->flags & Binary_Expression::NO_UNSIGNED_WRAP) printf(" nuw");
                 } else if (auto un = I->as<Unary_Expression>()) {
                     printf("unary\t");
                     const char *op;
                     switch (un->op) {
                         case '+': op = "+"; break;
                         case '-': op = "-"; break;
+                        case Unary_Expression::SIGN_EXTEND: op = "sext "; break;
+                        case Unary_Expression::ZERO_EXTEND: op = "zext "; break;
+                        case Unary_Expression::TRUNCATE:    op = "trunc "; break;
                         default: assert(false && "Interal Compiler Error: printing unknown unary operator");
                     }
                     printf("%s", op);
                     print_value(un->operand);
                 } else if (auto call = I->as<Function_Call>()) {
-                    printf("call\t%s", call->name);
+                    String callee_name = atom_table.name(module->functions[call->callee]->ast->name);
+                    printf("call\t%.*s", (int)callee_name.length, callee_name.data);
+
+                    auto arguments = function->call_arguments(call);
 
                     printf("(");
                     for (u32 arg_index = 0;
-                         arg_index < call->arguments.size();
+                         arg_index < arguments.size();
                          arg_index++) {
-                        auto arg = call->arguments[arg_index];
+                        auto arg = arguments[arg_index];
                         print_value(arg);
 
-                        if (arg_index != call->arguments.size() - 1) {
+                        if (arg_index != arguments.size() - 1) {
                             printf(", ");
                         }
                     }
@@ -411,20 +779,43 @@ internal void print_il_module(IL::Module *module) {
 
                     printf(" ? .L_%u_%u : .L_%u_%u",
                             func_index,
-                            br->true_target->i,
+                            br->true_target,
                             func_index,
-                            br->false_target->i);
+                            br->false_target);
 
                 } else if (auto jmp = I->as<Jump>()) {
-                    printf("jmp\t.L_%u_%u", func_index, jmp->target->i);
+                    printf("jmp\t.L_%u_%u", func_index, jmp->target);
                 } else if (auto ret = I->as<Return>()) {
                     printf("ret");
 
-                    if (ret->return_value) {
+                    if (ret->return_value != no_value) {
                         printf("\t");
                         print_value(ret->return_value);
                     }
 
+                } else if (auto phi = I->as<Phi>()) {
+                    printf("phi\t");
+
+                    for (u32 i = 0; i < phi->incoming_count; i++) {
+                        auto incoming = function->phi_incoming[phi->first_incoming + i];
+
+                        printf("[");
+                        print_value(incoming.value);
+                        printf(", .L_%u_%u]", func_index, incoming.block);
+
+                        if (i != phi->incoming_count - 1) {
+                            printf(", ");
+                        }
+                    }
+                } else if (auto arg = I->as<Argument>()) {
+                    printf("arg\t%u", arg->index);
+                } else if (I->type == Value::UNDEF) {
+                    printf("undef");
+                }
+
+                if (I->value_type) {
+                    printf(" : ");
+                    print_type(I->value_type);
                 }
 
                 printf("\n");
@@ -1,151 +1,420 @@
 
-namespace llvm {
-    struct Value;
-};
-
 namespace IL {
 
-    /* @TODO
-     * Do we really need a numbering for each Value?
+    /* @note
+     * Instructions are stored inline in Function::values and named by their
+     * index there, the value number. Operands are value numbers too, and
+     * jump targets are indices into Function::blocks, so a function's IL is
+     * a few flat arrays with no pointers in them. Anything a later stage
+     * wants to attach to a value (like the LLVM value it was lowered to)
+     * goes into a side table of its own, indexed by value number.
+     *
+     * Every value that is one has the type it has in the source, see
+     * Value::value_type, and instructions work at its width: an i8 add
+     * wraps at 8 bits. Operands of an instruction have the same width as
+     * each other; what changes the width is an explicit extend or truncate,
+     * which convert_expression puts in wherever the source mixes types.
      */
-    struct Value {
-        enum _Type {
-            UNDEF,
-            CONSTANT,
-            ALLOCA,
-            BINARY_EXPRESSION,
-            UNARY_EXPRESSION,
-            FUNCTION_CALL,
-            LOAD,
-            STORE,
-            BRANCH,
-            JUMP,
-            RETURN
-        } type;
+    typedef u32 Value_Id;
 
-        u32 n;
+    const Value_Id no_value = ~0u;
 
-        /* @note
-         * Paying 8 bytes to get O(1) lookup when looking for converted value
-         * in LLVM Converter.
-         */
-        llvm::Value *llvm_value;
+    /* @note
+     * The payload of each kind of value. A Value holds exactly one of them,
+     * and Value::as<T>() gives a pointer to it if that's the kind.
+     */
+    struct Constant {
+        static const u32 TYPE = 1;
 
-        template<typename VT>
-        VT *as() {
-            return (type == VT::TYPE) ? static_cast<VT *>(this) : nullptr;
-        }
+        u64 value;
     };
 
-    struct Basic_Block {
-        u32 i; // index in function->blocks
-        Array<Value *> instructions;
+    struct Alloca {
+        static const u32 TYPE = 2;
+
+        u32 size; // of value_type, which is what it holds
     };
 
-    struct Constant : Value {
-        static const Value::_Type TYPE = Value::CONSTANT;
-        Constant() { type = Value::CONSTANT; }
+    struct Binary_Expression {
+        static const u32 TYPE = 3;
+
+        // Operators of the source are their character, '/' and '%' being
+        // the signed ones. These have no character of their own: unsigned
+        // division for unsigned operands, and what reduce_strength turns
+        // multiplies and divisions by constants into.
+        enum : u32 {
+            UNSIGNED_DIV = 256,
+            UNSIGNED_MOD,
+            SHIFT_LEFT,
+            SHIFT_RIGHT,          // arithmetic
+            UNSIGNED_SHIFT_RIGHT, // logical
+            MULTIPLY_HIGH,        // top half of the double width product
+            UNSIGNED_MULTIPLY_HIGH,
+            UNSIGNED_LESS         // '<' of unsigned operands
+        };
+
+        // what propagate_ranges proved about + - *, for LLVM's nsw and nuw
+        enum : u32 {
+            NO_SIGNED_WRAP   = 1 << 0,
+            NO_UNSIGNED_WRAP = 1 << 1
+        };
 
-        u64 value;
+        u32 op;
+        Value_Id lhs, rhs;
+        u32 flags;
     };
 
-    struct Alloca : Value {
-        static const Value::_Type TYPE = Value::ALLOCA;
-        Alloca() { type = Value::ALLOCA; }
-        
-        u32 size;
-    };
+    struct Unary_Expression {
+        static const u32 TYPE = 4;
 
-    struct Binary_Expression : Value {
-        static const Value::_Type TYPE = Value::BINARY_EXPRESSION;
-        Binary_Expression() { type = Value::BINARY_EXPRESSION; }
+        // '-' and '+' of the source, and conversions to the value's type
+        // from the operand's, which is narrower to extend and wider to
+        // truncate. Conversions between types of the same size are free,
+        // the value just gets used as the other one.
+        enum : u32 {
+            SIGN_EXTEND = 256,
+            ZERO_EXTEND,
+            TRUNCATE
+        };
 
         u32 op;
+        Value_Id operand;
+    };
 
-        Value *lhs, *rhs;
+    struct Function_Call {
+        static const u32 TYPE = 5;
+
+        u32 callee;         // index into Module::functions
+        u32 first_argument; // into Function::arguments
+        u32 argument_count;
     };
 
-    struct Unary_Expression : Value {
-        static const Value::_Type TYPE = Value::UNARY_EXPRESSION;
-        Unary_Expression() { type = Value::UNARY_EXPRESSION; }
+    struct Load {
+        static const u32 TYPE = 6;
 
-        u32 op;
+        Value_Id base;
+        Value_Id offset; // in bytes
+    };
 
-        Value *operand;
+    struct Store {
+        static const u32 TYPE = 7;
+
+        Value_Id base;
+        Value_Id offset; // in bytes
+        Value_Id source;
     };
 
-    struct Function_Call : Value {
-        static const Value::_Type TYPE = Value::FUNCTION_CALL;
-        Function_Call() { type = Value::FUNCTION_CALL; }
+    struct Branch {
+        static const u32 TYPE = 8;
 
-        char *name;
-        Array<Value *> arguments;
+        Value_Id condition;
+        u32 true_target,  // block indices
+            false_target;
     };
 
-    struct Load : Value {
-        static const Value::_Type TYPE = Value::LOAD;
-        Load() { type = Value::LOAD; }
+    struct Jump {
+        static const u32 TYPE = 9;
 
-        Value *base;
-        Value *offset; // in bytes
+        u32 target; // block index
     };
 
-    struct Store : Value {
-        static const Value::_Type TYPE = Value::STORE;
-        Store() { type = Value::STORE; }
+    struct Return {
+        static const u32 TYPE = 10;
 
-        Value *base;
-        Value *offset; // in bytes
-        Value *source;
+        Value_Id return_value; // or no_value
     };
 
-    struct Branch : Value {
-        static const Value::_Type TYPE = Value::BRANCH;
-        Branch() { type = Value::BRANCH; }
+    // Merges the values of a variable at the start of a block, one incoming
+    // value per predecessor. Phis come first in their block.
+    struct Phi {
+        static const u32 TYPE = 11;
 
-        Value *condition;
-        Basic_Block *true_target,
-                    *false_target;
+        u32 first_incoming; // into Function::phi_incoming
+        u32 incoming_count;
     };
 
-    struct Jump : Value {
-        static const Value::_Type TYPE = Value::JUMP;
-        Jump() { type = Value::JUMP; }
+    // The function's index-th argument. Only in the entry block, where
+    // convert_function spills each one to an alloca like any variable.
+    struct Argument {
+        static const u32 TYPE = 12;
+
+        u32 index;
+    };
 
-        Basic_Block *target;
+    struct Phi_Incoming {
+        Value_Id value;
+        u32 block; // the predecessor it comes from
     };
 
-    struct Return : Value {
-        static const Value::_Type TYPE = Value::RETURN;
-        Return() { type = Value::RETURN; }
+    struct Value {
+        enum _Type : u32 {
+            UNDEF,            // reads of variables nobody wrote
+            CONSTANT          = Constant::TYPE,
+            ALLOCA            = Alloca::TYPE,
+            BINARY_EXPRESSION = Binary_Expression::TYPE,
+            UNARY_EXPRESSION  = Unary_Expression::TYPE,
+            FUNCTION_CALL     = Function_Call::TYPE,
+            LOAD              = Load::TYPE,
+            STORE             = Store::TYPE,
+            BRANCH            = Branch::TYPE,
+            JUMP              = Jump::TYPE,
+            RETURN            = Return::TYPE,
+            PHI               = Phi::TYPE,
+            ARGUMENT          = Argument::TYPE
+        } type;
+
+        // An integer type for values, the return type for calls, nullptr
+        // for stores, branches and the like. Comparisons are i32, 0 or 1.
+        AST::Type *value_type = nullptr;
+
+        union {
+            Constant          constant;
+            Alloca            alloca;
+            Binary_Expression binary;
+            Unary_Expression  unary;
+            Function_Call     call;
+            Load              load;
+            Store             store;
+            Branch            branch;
+            Jump              jump;
+            Return            ret;
+            Phi               phi;
+            Argument          argument;
+        };
+
+        template<typename VT>
+        VT *as() {
+            return (type == VT::TYPE) ? (VT *)&constant : nullptr;
+        }
+    };
+
+    // A run of value numbers, for range-for
+    struct Value_List {
+        Value_Id *first;
+        u32 count;
+
+        Value_Id *begin() { return first; }
+        Value_Id *end()   { return first + count; }
+        u32 size()        { return count; }
+        Value_Id operator[](u32 i) { return first[i]; }
+    };
+
+    struct Basic_Block {
+        Array<Value_Id> instructions;
+    };
+
+    const u32 no_block = ~0u;
+    const u32 no_loop  = ~0u;
+
+    /* @note
+     * Analyses of a function's IL, computed on first use and cached on the
+     * function until something changes the IL. get_cfg() and friends in
+     * il_analysis.cpp compute what they depend on too. A pass that changes
+     * the IL calls invalidate_analyses() with the ones it kept intact;
+     * Function::insert and insert_block throw everything away.
+     */
+    struct CFG {
+        Array<Array<u32>> successors;
+        Array<Array<u32>> predecessors; // one entry per edge, so maybe twice
+    };
+
+    // Unreachable blocks have no idom and aren't in the reverse postorder.
+    struct Dominator_Tree {
+        Array<u32> reverse_postorder;
+        Array<u32> rpo_index;           // no_block if unreachable
+        Array<u32> idom;                // no_block if unreachable, 0 for 0
+        Array<Array<u32>> children;
+        Array<Array<u32>> frontier;
+    };
+
+    struct Loop {
+        u32 header;
+        u32 parent;          // no_loop if outermost
+        u32 depth;           // 1 if outermost
+        Array<u32> blocks;   // header first
+        Array<u32> latches;  // blocks jumping back to the header
+    };
+
+    // Natural loops, outer loops before the loops nested in them.
+    struct Loop_Nest {
+        Array<Loop> loops;
+        Array<u32> loop_of;  // innermost loop of each block, or no_loop
+    };
 
-        Value *return_value;
+    // Values live on entry to and exit from each block, sorted by value
+    // number. Constants and undef aren't tracked, they're never in a
+    // register for long.
+    struct Liveness {
+        Array<Array<Value_Id>> live_in;
+        Array<Array<Value_Id>> live_out;
+    };
+
+    // The values an i32 can take, lo to hi inclusive, as signed. Empty if
+    // lo > hi: never computed, or only on paths that can't run. Values of
+    // other widths aren't tracked, they're all the full range.
+    struct Range {
+        i64 lo, hi;
+    };
+
+    // Ranges of each value where it's defined, see get_ranges. Branches
+    // tell more about a value further down, refined_range works that out.
+    struct Value_Ranges {
+        Array<Range> of_value;
+
+        // A block only entered from one side of a branch knows which way
+        // the condition went, and so does everything it dominates
+        struct Fact { Value_Id condition; bool taken; };
+        Array<Fact> fact;         // by block, condition no_value if none
+        Array<u32>  nearest_fact; // the block itself or the closest dominator with a fact, or no_block
+    };
+
+    struct Analyses {
+        enum : u32 {
+            CFG_EDGES  = 1 << 0,
+            DOMINATORS = 1 << 1,
+            LOOPS      = 1 << 2,
+            LIVENESS   = 1 << 3,
+            RANGES     = 1 << 4,
+            ALL        = CFG_EDGES | DOMINATORS | LOOPS | LIVENESS | RANGES
+        };
+
+        u32 valid = 0;
+
+        CFG            cfg;
+        Dominator_Tree dominators;
+        Loop_Nest      loops;
+        Liveness       liveness;
+        Value_Ranges   ranges;
+    };
+
+    // What number_values did to a function, for -stats. It runs more than
+    // once: the counts of what it did add up, the instruction counts are
+    // from before the first run and after the last, so the pipeline's
+    // Pass_Manager table is where each run's own counts are.
+    struct Value_Numbering_Stats {
+        u32 runs;
+        u32 instructions_before, instructions_after;
+        u32 constants_merged;
+        u32 folded;
+        u32 redundant;
+        u32 phis_removed;
+    };
+
+    // What eliminate_dead_code did to a function, for -stats. Counted
+    // across runs like Value_Numbering_Stats.
+    struct Dead_Code_Stats {
+        u32 runs;
+        u32 instructions_before, instructions_after;
+        u32 blocks_removed;
+        u32 blocks_merged;
+        u32 branches_folded;
+    };
+
+    // What infer_function_attributes proved about a function, for LLVM.
+    // READ_NONE and READ_ONLY are about memory its callers can see.
+    struct Function_Attributes {
+        enum : u32 {
+            READ_NONE   = 1 << 0,
+            READ_ONLY   = 1 << 1,
+            NO_RECURSE  = 1 << 2,
+            WILL_RETURN = 1 << 3
+        };
+    };
+
+    // What propagate_ranges did to a function, for -stats
+    struct Value_Range_Stats {
+        u32 compares_folded;
+        u32 values_folded; // everything else that turned out constant
+        u32 no_wrap;       // + - * marked nsw or nuw
+    };
+
+    // What reduce_strength did to a function, for -stats
+    struct Strength_Reduction_Stats {
+        u32 multiplies;          // by constants, into shifts
+        u32 divisions;           // / and % by constants
+        u32 induction_variables; // multiplies of loop counters into additions
     };
 
     struct Function {
         AST::Function *ast;
-        Array<Basic_Block *> blocks;
 
-        u32 value_count = 0;
+        u32 attributes = 0;   // Function_Attributes
+        bool removed = false; // by eliminate_dead_functions, still in Module::functions so indices hold
+
+        Array<Value> values;          // indexed by value number
+        Array<Basic_Block> blocks;    // block 0 is the entry
+        Array<Value_Id> arguments;    // runs of call arguments, see Function_Call
+        Array<Phi_Incoming> phi_incoming;
+
+        Analyses analyses;
+
+        Value_Numbering_Stats value_numbering = {};
+        Dead_Code_Stats dead_code = {};
+        Value_Range_Stats range_propagation = {};
+        Strength_Reduction_Stats strength_reduction = {};
+
+        Value *value(Value_Id n) { return &values[n]; }
+        u32 value_count() { return values.size(); }
+
+        u32 insert_block() {
+            analyses.valid = 0;
+            blocks.emplace_back();
+            return blocks.size() - 1;
+        }
+
+        Value_List call_arguments(Function_Call *call) {
+            Value_List list;
+            list.first = arguments.data() + call->first_argument;
+            list.count = call->argument_count;
+            return list;
+        }
 
-        Basic_Block *insert_block() {
-            auto bb = new Basic_Block;
-            bb->i   = blocks.size();
-            blocks.push_back(bb);
-            return bb;
+        // Calls fn(Value_Id &operand) on every value v uses, so passes can
+        // also rewrite them. Block indices aren't operands.
+        template <typename Fn>
+        void for_each_operand(Value *v, Fn fn) {
+            auto visit = [&](Value_Id &operand) {
+                if (operand != no_value) fn(operand);
+            };
+
+            switch (v->type) {
+                case Value::BINARY_EXPRESSION: visit(v->binary.lhs); visit(v->binary.rhs); break;
+                case Value::UNARY_EXPRESSION:  visit(v->unary.operand); break;
+                case Value::LOAD:   visit(v->load.base); visit(v->load.offset); break;
+                case Value::STORE:  visit(v->store.source); visit(v->store.base); visit(v->store.offset); break;
+                case Value::BRANCH: visit(v->branch.condition); break;
+                case Value::RETURN: visit(v->ret.return_value); break;
+
+                case Value::FUNCTION_CALL: {
+                    for (u32 i = 0; i < v->call.argument_count; i++) {
+                        visit(arguments[v->call.first_argument + i]);
+                    }
+                } break;
+
+                case Value::PHI: {
+                    for (u32 i = 0; i < v->phi.incoming_count; i++) {
+                        visit(phi_incoming[v->phi.first_incoming + i].value);
+                    }
+                } break;
+
+                default: break;
+            }
         }
 
         // @cleanup, FIXME
-        Constant *insert_constant(Basic_Block *bb, u64 value);
-        Alloca *insert_alloca(Basic_Block *bb, u32 size);
-        Binary_Expression *insert_binary(Basic_Block *bb, u32 op, Value *lhs, Value *rhs);
-        Unary_Expression *insert_unary(Basic_Block *bb, u32 op, Value *operand);
-        Function_Call *insert_call(Basic_Block *bb, char *name, Array<Value *> *arguments);
-        Load *insert_load(Basic_Block *bb, Value *base, Value *offset = nullptr);
-        Store *insert_store(Basic_Block *bb, Value *source, Value *base, Value *offset = nullptr);
-        Branch *insert_branch(Basic_Block *bb, Value *condition, Basic_Block *true_target, Basic_Block *false_target);
-        Jump *insert_jump(Basic_Block *bb, Basic_Block *target);
-        Return *insert_return(Basic_Block *bb, Value *return_value = nullptr);
+        Value_Id insert_constant(u32 bb, u64 value, AST::Type *type);
+        Value_Id insert_alloca(u32 bb, AST::Type *type);
+        Value_Id insert_binary(u32 bb, u32 op, Value_Id lhs, Value_Id rhs, AST::Type *type);
+        Value_Id insert_unary(u32 bb, u32 op, Value_Id operand, AST::Type *type);
+        Value_Id insert_call(u32 bb, u32 callee, Value_Id *arguments, u32 argument_count, AST::Type *type);
+        Value_Id insert_load(u32 bb, Value_Id base, Value_Id offset = no_value);
+        Value_Id insert_store(u32 bb, Value_Id source, Value_Id base, Value_Id offset = no_value);
+        Value_Id insert_branch(u32 bb, Value_Id condition, u32 true_target, u32 false_target);
+        Value_Id insert_jump(u32 bb, u32 target);
+        Value_Id insert_return(u32 bb, Value_Id return_value = no_value);
+        Value_Id insert_argument(u32 bb, u32 index, AST::Type *type);
+
+        Value_Id insert(u32 bb, Value value);
     };
 
     struct Module {
@@ -153,6 +422,88 @@ namespace IL {
         Array<Function *> functions;
     };
 
+    // Who calls whom, by index into Module::functions. Each callee and
+    // caller once, however many calls there are.
+    struct Call_Graph {
+        Array<Array<u32>> callees;
+        Array<Array<u32>> callers;
+        Array<u32> postorder; // callees before their callers, where there's no cycle
+    };
+
+    typedef bool (*Function_Pass)(Function *f); // true if it changed f
+    typedef u32  (*Module_Pass)(Module *m);     // how many functions it changed
+
+    struct Pass {
+        const char *name;
+        Function_Pass function_pass; // one or the other
+        Module_Pass   module_pass;
+
+        // totals over the whole module, for -stats
+        u32 runs;
+        u32 functions_changed;
+        double seconds;
+        u64 instructions_before, instructions_after;
+    };
+
+    /* @note
+     * The IL passes to run, in order. Function passes up to the first module
+     * pass run on each function right after it's converted, so they also
+     * run in the pipelined front end. The rest run in order once the whole
+     * module is converted, a function pass among them on every function.
+     * Only one thread runs passes at a time, the stats aren't synchronized.
+     */
+    struct Pass_Manager {
+        Array<Pass> passes;
+        u32 first_module_pass = 0;
+    };
+
+    // il_analysis.cpp
+    internal CFG            *get_cfg(Function *f);
+    internal Dominator_Tree *get_dominators(Function *f);
+    internal Loop_Nest      *get_loops(Function *f);
+    inline   Liveness       *get_liveness(Function *f);
+    internal void invalidate_analyses(Function *f, u32 preserved = 0);
+
+    // il_ssa.cpp
+    internal bool promote_allocas(Function *f);
+
+    // il_gvn.cpp
+    internal bool number_values(Function *f);
+
+    // il_ranges.cpp
+    internal Value_Ranges *get_ranges(Function *f);
+    internal Range refined_range(Function *f, Value_Ranges *ranges, Dominator_Tree *d, Value_Id n, u32 bb);
+    internal bool propagate_ranges(Function *f);
+
+    // il_strength.cpp
+    internal bool reduce_strength(Function *f);
+
+    // il_dce.cpp
+    internal bool eliminate_dead_code(Function *f);
+
+    // il_loops.cpp
+    internal bool rotate_loops(Function *f);
+    internal bool hoist_loop_invariants(Function *f);
+
+    // il_calls.cpp
+    internal void build_call_graph(Module *m, Call_Graph *cg);
+    internal u32 eliminate_dead_functions(Module *m);
+    internal u32 infer_function_attributes(Module *m);
+
+    // il_inline.cpp
+    internal u32 inline_calls(Module *m);
+    internal u32 inline_forced_calls(Module *m);
+
+    // il_passes.cpp
+    internal void build_pipeline(Pass_Manager *pm, u32 optimization_level, bool has_forced_inlines);
+    internal void run_function_passes(Pass_Manager *pm, Function *f);
+    internal void run_module_passes(Pass_Manager *pm, Module *m);
+
 };
 
 internal void print_il_module(IL::Module *module);
+internal void print_value_numbering_stats(IL::Module *module);
+internal void print_dead_code_stats(IL::Module *module);
+internal void print_range_stats(IL::Module *module);
+internal void print_strength_stats(IL::Module *module);
+internal void print_pass_stats(IL::Pass_Manager *pm);
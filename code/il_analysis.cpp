@@ -0,0 +1,343 @@
+
+namespace IL {
+
+    // The block's first branch, jump or return. Until eliminate_dead_code
+    // has run, whatever follows it in the block never runs.
+    internal Value *terminator(Function *f, u32 bb) {
+        for (auto n : f->blocks[bb].instructions) {
+            auto v = f->value(n);
+            if (v->type == Value::BRANCH || v->type == Value::JUMP || v->type == Value::RETURN) {
+                return v;
+            }
+        }
+
+        return nullptr; // falls off the end
+    }
+
+    internal bool is_reachable(Dominator_Tree *d, u32 bb) {
+        return d->rpo_index[bb] != no_block;
+    }
+
+    // Whether a dominates b, both reachable
+    internal bool dominates(Dominator_Tree *d, u32 a, u32 b) {
+        while (d->rpo_index[b] > d->rpo_index[a]) b = d->idom[b];
+        return a == b;
+    }
+
+    internal void invalidate_analyses(Function *f, u32 preserved) {
+        // everything is built on the edges, and loops on the dominators
+        if (!(preserved & Analyses::CFG_EDGES))  preserved = 0;
+        if (!(preserved & Analyses::DOMINATORS)) preserved &= ~Analyses::LOOPS;
+
+        f->analyses.valid &= preserved;
+    }
+
+    internal CFG *get_cfg(Function *f) {
+        auto cfg = &f->analyses.cfg;
+        if (f->analyses.valid & Analyses::CFG_EDGES) return cfg;
+
+        u32 block_count = f->blocks.size();
+
+        cfg->successors.assign(block_count, Array<u32>());
+        cfg->predecessors.assign(block_count, Array<u32>());
+
+        for (u32 bb = 0; bb < block_count; bb++) {
+            auto term = terminator(f, bb);
+            if (!term) continue;
+
+            if (term->type == Value::BRANCH) {
+                cfg->successors[bb].push_back(term->branch.true_target);
+                cfg->successors[bb].push_back(term->branch.false_target);
+            } else if (term->type == Value::JUMP) {
+                cfg->successors[bb].push_back(term->jump.target);
+            }
+
+            for (auto s : cfg->successors[bb]) cfg->predecessors[s].push_back(bb);
+        }
+
+        f->analyses.valid |= Analyses::CFG_EDGES;
+        return cfg;
+    }
+
+    /* @note
+     * Dominators are computed with the iterative algorithm from Cooper,
+     * Harvey and Kennedy, "A Simple, Fast Dominance Algorithm", over the
+     * reverse postorder.
+     */
+    internal Dominator_Tree *get_dominators(Function *f) {
+        auto d = &f->analyses.dominators;
+        if (f->analyses.valid & Analyses::DOMINATORS) return d;
+
+        auto cfg = get_cfg(f);
+        u32 block_count = f->blocks.size();
+
+        d->rpo_index.assign(block_count, no_block);
+        d->idom.assign(block_count, no_block);
+        d->children.assign(block_count, Array<u32>());
+        d->frontier.assign(block_count, Array<u32>());
+        d->reverse_postorder.clear();
+
+        if (block_count) {
+            // postorder with an explicit stack, loops nest as deep as they like
+            struct Frame { u32 bb; u32 next_successor; };
+            Array<Frame> stack;
+            Array<u8> visited(block_count, 0);
+
+            stack.push_back({0, 0});
+            visited[0] = 1;
+
+            while (stack.size()) {
+                auto &top = stack.back();
+
+                if (top.next_successor < cfg->successors[top.bb].size()) {
+                    u32 s = cfg->successors[top.bb][top.next_successor++];
+                    if (!visited[s]) {
+                        visited[s] = 1;
+                        stack.push_back({s, 0});
+                    }
+                } else {
+                    d->reverse_postorder.push_back(top.bb);
+                    stack.pop_back();
+                }
+            }
+
+            std::reverse(d->reverse_postorder.begin(), d->reverse_postorder.end());
+        }
+
+        for (u32 i = 0; i < d->reverse_postorder.size(); i++) {
+            d->rpo_index[d->reverse_postorder[i]] = i;
+        }
+
+        auto intersect = [&](u32 a, u32 b) {
+            while (a != b) {
+                while (d->rpo_index[a] > d->rpo_index[b]) a = d->idom[a];
+                while (d->rpo_index[b] > d->rpo_index[a]) b = d->idom[b];
+            }
+            return a;
+        };
+
+        if (block_count) d->idom[0] = 0;
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+
+            for (u32 i = 1; i < d->reverse_postorder.size(); i++) {
+                u32 bb = d->reverse_postorder[i];
+                u32 new_idom = no_block;
+
+                for (auto p : cfg->predecessors[bb]) {
+                    if (d->idom[p] == no_block) continue; // not processed yet, or unreachable
+
+                    new_idom = (new_idom == no_block) ? p : intersect(p, new_idom);
+                }
+
+                if (d->idom[bb] != new_idom) {
+                    d->idom[bb] = new_idom;
+                    changed = true;
+                }
+            }
+        }
+
+        for (auto bb : d->reverse_postorder) {
+            if (bb != 0) d->children[d->idom[bb]].push_back(bb);
+        }
+
+        // a join point is in the frontier of everything on the way up from
+        // each of its predecessors to its idom
+        for (auto bb : d->reverse_postorder) {
+            if (cfg->predecessors[bb].size() < 2) continue;
+
+            for (auto p : cfg->predecessors[bb]) {
+                if (!is_reachable(d, p)) continue;
+
+                for (u32 runner = p; runner != d->idom[bb]; runner = d->idom[runner]) {
+                    auto &df = d->frontier[runner];
+                    if (df.empty() || df.back() != bb) df.push_back(bb);
+                }
+            }
+        }
+
+        f->analyses.valid |= Analyses::DOMINATORS;
+        return d;
+    }
+
+    /* @note
+     * A natural loop for every block some reachable block jumps back to
+     * while being dominated by it, its header. The loop is the header and
+     * everything that reaches one of those latches without going through
+     * the header. Headers are taken in reverse postorder, so a loop comes
+     * after the ones it is nested in and loop_of ends up innermost.
+     * Back edges to a block that doesn't dominate their source (irreducible
+     * control flow) make no loop; the front end can't produce them anyway.
+     */
+    internal Loop_Nest *get_loops(Function *f) {
+        auto nest = &f->analyses.loops;
+        if (f->analyses.valid & Analyses::LOOPS) return nest;
+
+        auto cfg = get_cfg(f);
+        auto d   = get_dominators(f);
+
+        nest->loops.clear();
+        nest->loop_of.assign(f->blocks.size(), no_loop);
+
+        Array<u32> in_loop(f->blocks.size(), no_loop);
+        Array<u32> worklist;
+
+        for (auto header : d->reverse_postorder) {
+            Loop loop;
+
+            for (auto p : cfg->predecessors[header]) {
+                if (is_reachable(d, p) && dominates(d, header, p)) {
+                    if (loop.latches.empty() || loop.latches.back() != p) loop.latches.push_back(p);
+                }
+            }
+
+            if (loop.latches.empty()) continue;
+
+            u32 index = nest->loops.size();
+
+            loop.header = header;
+            loop.parent = nest->loop_of[header];
+            loop.depth  = (loop.parent == no_loop) ? 1 : nest->loops[loop.parent].depth + 1;
+
+            loop.blocks.push_back(header);
+            in_loop[header] = index;
+
+            worklist = loop.latches;
+            while (worklist.size()) {
+                u32 bb = worklist.back();
+                worklist.pop_back();
+
+                if (in_loop[bb] == index) continue;
+                in_loop[bb] = index;
+                loop.blocks.push_back(bb);
+
+                for (auto p : cfg->predecessors[bb]) {
+                    if (is_reachable(d, p) && in_loop[p] != index) worklist.push_back(p);
+                }
+            }
+
+            for (auto bb : loop.blocks) nest->loop_of[bb] = index;
+
+            nest->loops.push_back(std::move(loop));
+        }
+
+        f->analyses.valid |= Analyses::LOOPS;
+        return nest;
+    }
+
+    /* @note
+     * SSA liveness by walking up from each use to the definition, as in
+     * Brandner et al., "Computing Liveness Sets for SSA-Form Programs".
+     * A use by a phi is a use at the end of the predecessor it comes from.
+     * Values are done one at a time in order, so the sets come out sorted
+     * and a block is only marked once per value.
+     *
+     * Nothing asks for liveness yet, it's here for a register allocator.
+     * Until then these are inline, so they don't warn for being unused.
+     */
+    inline Liveness *get_liveness(Function *f) {
+        auto live = &f->analyses.liveness;
+        if (f->analyses.valid & Analyses::LIVENESS) return live;
+
+        auto cfg = get_cfg(f);
+
+        u32 block_count = f->blocks.size();
+        u32 value_count = f->value_count();
+
+        live->live_in.assign(block_count, Array<Value_Id>());
+        live->live_out.assign(block_count, Array<Value_Id>());
+
+        Array<u32> def_block(value_count, no_block);
+        for (u32 bb = 0; bb < block_count; bb++) {
+            for (auto n : f->blocks[bb].instructions) def_block[n] = bb;
+        }
+
+        auto tracked = [&](Value_Id n) {
+            auto type = f->value(n)->type;
+            return def_block[n] != no_block && type != Value::CONSTANT && type != Value::UNDEF;
+        };
+
+        // uses grouped by value: the block each one is in, or for a phi,
+        // the block it comes from with is_phi set
+        struct Use { u32 block; bool is_phi; };
+        Array<u32> first_use(value_count + 1, 0);
+        Array<Use> uses;
+
+        auto for_each_use = [&](auto fn) {
+            for (u32 bb = 0; bb < block_count; bb++) {
+                for (auto n : f->blocks[bb].instructions) {
+                    auto v = f->value(n);
+
+                    if (auto phi = v->as<Phi>()) {
+                        for (u32 i = 0; i < phi->incoming_count; i++) {
+                            auto incoming = f->phi_incoming[phi->first_incoming + i];
+                            if (tracked(incoming.value)) fn(incoming.value, Use{incoming.block, true});
+                        }
+                    } else {
+                        f->for_each_operand(v, [&](Value_Id &operand) {
+                            if (tracked(operand)) fn(operand, Use{bb, false});
+                        });
+                    }
+                }
+            }
+        };
+
+        for_each_use([&](Value_Id n, Use) { first_use[n + 1]++; });
+        for (u32 n = 0; n < value_count; n++) first_use[n + 1] += first_use[n];
+
+        uses.resize(first_use[value_count]);
+        Array<u32> next_use(first_use.begin(), first_use.end() - 1);
+        for_each_use([&](Value_Id n, Use use) { uses[next_use[n]++] = use; });
+
+        Array<Value_Id> marked_in(block_count, no_value), marked_out(block_count, no_value);
+        Array<u32> worklist;
+
+        for (Value_Id n = 0; n < value_count; n++) {
+            if (first_use[n] == first_use[n + 1]) continue;
+
+            // blocks the value is live out of, to walk up from
+            auto live_out_of = [&](u32 bb) {
+                if (marked_out[bb] == n) return;
+                marked_out[bb] = n;
+                live->live_out[bb].push_back(n);
+                worklist.push_back(bb);
+            };
+
+            auto live_in_to = [&](u32 bb) {
+                if (bb == def_block[n] || marked_in[bb] == n) return;
+                marked_in[bb] = n;
+                live->live_in[bb].push_back(n);
+
+                for (auto p : cfg->predecessors[bb]) live_out_of(p);
+            };
+
+            for (u32 i = first_use[n]; i < first_use[n + 1]; i++) {
+                if (uses[i].is_phi) live_out_of(uses[i].block);
+                else                live_in_to(uses[i].block);
+            }
+
+            while (worklist.size()) {
+                u32 bb = worklist.back();
+                worklist.pop_back();
+
+                live_in_to(bb);
+            }
+        }
+
+        f->analyses.valid |= Analyses::LIVENESS;
+        return live;
+    }
+
+    inline bool is_live_in(Liveness *live, u32 bb, Value_Id n) {
+        auto &set = live->live_in[bb];
+        return std::binary_search(set.begin(), set.end(), n);
+    }
+
+    inline bool is_live_out(Liveness *live, u32 bb, Value_Id n) {
+        auto &set = live->live_out[bb];
+        return std::binary_search(set.begin(), set.end(), n);
+    }
+
+};
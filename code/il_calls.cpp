@@ -0,0 +1,240 @@
+
+namespace IL {
+
+    internal void build_call_graph(Module *m, Call_Graph *cg) {
+        u32 function_count = m->functions.size();
+
+        cg->callees.assign(function_count, Array<u32>());
+        cg->callers.assign(function_count, Array<u32>());
+        cg->postorder.clear();
+
+        Array<u32> last_caller(function_count, ~0u); // to add each edge once
+
+        for (u32 i = 0; i < function_count; i++) {
+            auto f = m->functions[i];
+
+            for (auto &bb : f->blocks) {
+                for (auto n : bb.instructions) {
+                    auto call = f->value(n)->as<Function_Call>();
+                    if (!call || last_caller[call->callee] == i) continue;
+
+                    last_caller[call->callee] = i;
+                    cg->callees[i].push_back(call->callee);
+                    cg->callers[call->callee].push_back(i);
+                }
+            }
+        }
+
+        // postorder with an explicit stack, call chains go as deep as they like
+        struct Frame { u32 function; u32 next_callee; };
+        Array<Frame> stack;
+        Array<u8> visited(function_count, 0);
+
+        for (u32 root = 0; root < function_count; root++) {
+            if (visited[root]) continue;
+
+            visited[root] = 1;
+            stack.push_back({root, 0});
+
+            while (stack.size()) {
+                auto &top = stack.back();
+
+                if (top.next_callee < cg->callees[top.function].size()) {
+                    u32 callee = cg->callees[top.function][top.next_callee++];
+                    if (!visited[callee]) {
+                        visited[callee] = 1;
+                        stack.push_back({callee, 0});
+                    }
+                } else {
+                    cg->postorder.push_back(top.function);
+                    stack.pop_back();
+                }
+            }
+        }
+    }
+
+    /* @note
+     * Drops the functions nothing calls from main, directly or not. They
+     * stay in Module::functions, empty and marked removed, since calls name
+     * functions by index. Functions marked @c_function can be called from C,
+     * so they're kept like main. A module without main (a library) keeps
+     * everything it defines.
+     */
+    internal u32 eliminate_dead_functions(Module *m) {
+        u32 function_count = m->functions.size();
+
+        Call_Graph cg;
+        build_call_graph(m, &cg);
+
+        bool has_main = false;
+        for (auto f : m->functions) {
+            if (!f->blocks.empty() && string_match(atom_table.name(f->ast->name), "main")) has_main = true;
+        }
+
+        Array<u8> reached(function_count, 0);
+        Array<u32> worklist;
+
+        for (u32 i = 0; i < function_count; i++) {
+            auto f = m->functions[i];
+            if (f->removed) continue;
+
+            bool root;
+            if (f->ast->is_c_function) root = true;
+            else if (has_main)         root = string_match(atom_table.name(f->ast->name), "main");
+            else                       root = !f->blocks.empty();
+
+            if (root) {
+                reached[i] = 1;
+                worklist.push_back(i);
+            }
+        }
+
+        while (worklist.size()) {
+            u32 i = worklist.back();
+            worklist.pop_back();
+
+            for (auto callee : cg.callees[i]) {
+                if (!reached[callee]) {
+                    reached[callee] = 1;
+                    worklist.push_back(callee);
+                }
+            }
+        }
+
+        u32 removed_count = 0;
+
+        for (u32 i = 0; i < function_count; i++) {
+            auto f = m->functions[i];
+            if (reached[i] || f->removed) continue;
+
+            // give the memory back, the arena only has the Function itself
+            Array<Value>().swap(f->values);
+            Array<Basic_Block>().swap(f->blocks);
+            Array<Value_Id>().swap(f->arguments);
+            Array<Phi_Incoming>().swap(f->phi_incoming);
+            invalidate_analyses(f);
+
+            f->removed = true;
+            removed_count++;
+        }
+
+        return removed_count;
+    }
+
+    // How much of the memory its callers can see a function touches,
+    // ordered so that the larger effect wins
+    enum Memory_Effect : u32 { NO_MEMORY, READS_MEMORY, WRITES_MEMORY };
+
+    // Not counting its calls. Its own allocas are nobody else's business.
+    internal u32 own_memory_effect(Function *f) {
+        u32 effect = NO_MEMORY;
+
+        auto is_local = [&](Value_Id base) {
+            return f->value(base)->type == Value::ALLOCA;
+        };
+
+        for (auto &bb : f->blocks) {
+            for (auto n : bb.instructions) {
+                auto v = f->value(n);
+
+                if (auto load = v->as<Load>()) {
+                    if (!is_local(load->base)) effect = std::max(effect, (u32)READS_MEMORY);
+                } else if (auto store = v->as<Store>()) {
+                    if (!is_local(store->base)) effect = WRITES_MEMORY;
+                }
+            }
+        }
+
+        return effect;
+    }
+
+    // Any cycle in the CFG has an edge going back in reverse postorder,
+    // irreducible ones too
+    internal bool has_cycle(Function *f) {
+        auto cfg = get_cfg(f);
+        auto d   = get_dominators(f);
+
+        for (auto bb : d->reverse_postorder) {
+            for (auto s : cfg->successors[bb]) {
+                if (d->rpo_index[s] <= d->rpo_index[bb]) return true;
+            }
+        }
+
+        return false;
+    }
+
+    /* @note
+     * Declarations could do anything, so a function calling one gets
+     * nothing. Otherwise a function reads or writes what its callees do on
+     * top of its own loads and stores; cycles in the call graph go around
+     * until nothing changes. It doesn't recurse if nothing it calls can call
+     * it back, and it returns if it also has no loops. Those two are
+     * settled in postorder, where a callee that isn't done yet is in a
+     * cycle with the caller.
+     */
+    internal u32 infer_function_attributes(Module *m) {
+        u32 function_count = m->functions.size();
+
+        Call_Graph cg;
+        build_call_graph(m, &cg);
+
+        Array<u32> effect(function_count);
+        for (u32 i = 0; i < function_count; i++) {
+            auto f = m->functions[i];
+            effect[i] = f->blocks.empty() ? (u32)WRITES_MEMORY : own_memory_effect(f);
+        }
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+
+            for (auto i : cg.postorder) {
+                for (auto callee : cg.callees[i]) {
+                    if (effect[callee] > effect[i]) {
+                        effect[i] = effect[callee];
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        Array<u8> done(function_count, 0);
+        u32 changed_count = 0;
+
+        for (auto i : cg.postorder) {
+            auto f = m->functions[i];
+            done[i] = 1;
+
+            if (f->blocks.empty()) continue; // declarations and removed functions
+
+            u32 attributes = 0;
+
+            if (effect[i] == NO_MEMORY)    attributes |= Function_Attributes::READ_NONE;
+            if (effect[i] == READS_MEMORY) attributes |= Function_Attributes::READ_ONLY;
+
+            bool no_recurse = true, callees_return = true;
+
+            for (auto callee : cg.callees[i]) {
+                u32 callee_attributes = m->functions[callee]->attributes;
+
+                if (callee == i || !done[callee] || m->functions[callee]->blocks.empty() ||
+                    !(callee_attributes & Function_Attributes::NO_RECURSE)) {
+                    no_recurse = false;
+                }
+
+                if (!(callee_attributes & Function_Attributes::WILL_RETURN)) callees_return = false;
+            }
+
+            if (no_recurse) {
+                attributes |= Function_Attributes::NO_RECURSE;
+                if (callees_return && !has_cycle(f)) attributes |= Function_Attributes::WILL_RETURN;
+            }
+
+            if (f->attributes != attributes) changed_count++;
+            f->attributes = attributes;
+        }
+
+        return changed_count;
+    }
+
+};
@@ -0,0 +1,320 @@
+
+namespace IL {
+
+    internal bool has_side_effects(Value *v) {
+        switch (v->type) {
+            case Value::FUNCTION_CALL:
+            case Value::STORE:
+            case Value::BRANCH:
+            case Value::JUMP:
+            case Value::RETURN:
+                return true;
+
+            default:
+                return false;
+        }
+    }
+
+    // Drops the value coming in from pred from every phi in bb. Only one
+    // entry each, a block branching to bb both ways has two of them.
+    internal void remove_phi_incoming(Function *f, u32 bb, u32 pred) {
+        for (auto n : f->blocks[bb].instructions) {
+            auto phi = f->value(n)->as<Phi>();
+            if (!phi) continue;
+
+            auto incoming = &f->phi_incoming[phi->first_incoming];
+
+            for (u32 i = 0; i < phi->incoming_count; i++) {
+                if (incoming[i].block != pred) continue;
+
+                for (u32 j = i + 1; j < phi->incoming_count; j++) {
+                    incoming[j - 1] = incoming[j];
+                }
+                phi->incoming_count--;
+                break;
+            }
+        }
+    }
+
+    /* @note
+     * Cleans up what conversion and the other passes leave behind, on SSA
+     * form:
+     *  - anything after a block's first terminator is dropped,
+     *  - branches on a constant, or to the same block either way, become
+     *    jumps,
+     *  - blocks nothing reaches from the entry are removed, with their
+     *    edges out of phis,
+     *  - a block that is the only successor of its only predecessor is
+     *    merged into it,
+     *  - phis left with one incoming value are replaced by it,
+     *  - instructions without side effects whose results nobody uses are
+     *    dropped, mark and sweep from the ones that do have side effects.
+     * The blocks that are left are renumbered in reverse postorder, so the
+     * entry stays block 0 and definitions come before their uses.
+     */
+    internal bool eliminate_dead_code(Function *f) {
+        if (f->blocks.empty()) return false;
+
+        auto &stats = f->dead_code;
+
+        u32 block_count = f->blocks.size();
+        u32 instruction_count = 0;
+        u32 branches_folded_before = stats.branches_folded;
+
+        for (auto &bb : f->blocks) instruction_count += bb.instructions.size();
+        if (!stats.runs++) stats.instructions_before = instruction_count;
+        stats.instructions_after = 0;
+
+        for (auto &bb : f->blocks) {
+            auto &instructions = bb.instructions;
+
+            for (u32 i = 0; i < instructions.size(); i++) {
+                auto type = f->value(instructions[i])->type;
+
+                if (type == Value::BRANCH || type == Value::JUMP || type == Value::RETURN) {
+                    instructions.resize(i + 1);
+                    break;
+                }
+            }
+        }
+
+        for (u32 bb = 0; bb < block_count; bb++) {
+            auto &instructions = f->blocks[bb].instructions;
+            if (instructions.empty()) continue;
+
+            auto v = f->value(instructions.back());
+            auto br = v->as<Branch>();
+            if (!br) continue;
+
+            u32 taken, not_taken;
+
+            if (auto c = f->value(br->condition)->as<Constant>()) {
+                bool condition = c->value != 0;
+                taken     = condition ? br->true_target  : br->false_target;
+                not_taken = condition ? br->false_target : br->true_target;
+            } else if (br->true_target == br->false_target) {
+                taken = not_taken = br->true_target;
+            } else {
+                continue;
+            }
+
+            remove_phi_incoming(f, not_taken, bb);
+
+            v->type = Value::JUMP;
+            v->jump.target = taken;
+
+            stats.branches_folded++;
+        }
+
+        // branches became jumps
+        if (stats.branches_folded != branches_folded_before) invalidate_analyses(f);
+
+        auto cfg = get_cfg(f);
+        auto d   = get_dominators(f);
+
+        Array<u8> removed(block_count, 0);
+        Array<u32> predecessor_count(block_count, 0);
+
+        for (u32 bb = 0; bb < block_count; bb++) {
+            if (is_reachable(d, bb)) {
+                for (auto s : cfg->successors[bb]) predecessor_count[s]++;
+                continue;
+            }
+
+            for (auto s : cfg->successors[bb]) {
+                if (is_reachable(d, s)) remove_phi_incoming(f, s, bb);
+            }
+
+            removed[bb] = 1;
+            stats.blocks_removed++;
+        }
+
+        Array<Value_Id> replacement(f->value_count(), no_value);
+
+        auto resolve = [&](Value_Id n) {
+            while (replacement[n] != no_value) n = replacement[n];
+            return n;
+        };
+
+        for (auto bb : d->reverse_postorder) {
+            if (removed[bb]) continue;
+
+            auto &instructions = f->blocks[bb].instructions;
+
+            while (instructions.size()) {
+                auto jmp = f->value(instructions.back())->as<Jump>();
+                if (!jmp) break;
+
+                u32 s = jmp->target;
+                if (s == bb || s == 0 || predecessor_count[s] != 1) break;
+
+                instructions.pop_back();
+
+                for (auto n : f->blocks[s].instructions) {
+                    if (auto phi = f->value(n)->as<Phi>()) {
+                        assert(phi->incoming_count == 1);
+                        replacement[n] = f->phi_incoming[phi->first_incoming].value;
+                        continue;
+                    }
+
+                    instructions.push_back(n);
+                }
+
+                // edges out of s leave from bb now. s comes after its only
+                // predecessor in reverse postorder, so nothing has been
+                // merged into it and its successors are still right
+                for (auto t : cfg->successors[s]) {
+                    for (auto n : f->blocks[t].instructions) {
+                        auto phi = f->value(n)->as<Phi>();
+                        if (!phi) continue;
+
+                        for (u32 i = 0; i < phi->incoming_count; i++) {
+                            auto &incoming = f->phi_incoming[phi->first_incoming + i];
+                            if (incoming.block == s) incoming.block = bb;
+                        }
+                    }
+                }
+
+                f->blocks[s].instructions.clear();
+                removed[s] = 1;
+                stats.blocks_merged++;
+            }
+        }
+
+        // phis merging one value, now that edges are gone
+        for (u32 bb = 0; bb < block_count; bb++) {
+            if (removed[bb]) continue;
+
+            for (auto n : f->blocks[bb].instructions) {
+                auto phi = f->value(n)->as<Phi>();
+                if (!phi) continue;
+
+                Value_Id same = no_value;
+                bool trivial = true;
+
+                for (u32 i = 0; i < phi->incoming_count && trivial; i++) {
+                    Value_Id incoming = resolve(f->phi_incoming[phi->first_incoming + i].value);
+                    if (incoming == n || incoming == same) continue;
+
+                    if (same == no_value) same = incoming;
+                    else trivial = false;
+                }
+
+                if (trivial && same != no_value) replacement[n] = same;
+            }
+        }
+
+        Array<u8> live(f->value_count(), 0);
+        Array<Value_Id> worklist;
+
+        for (u32 bb = 0; bb < block_count; bb++) {
+            if (removed[bb]) continue;
+
+            for (auto n : f->blocks[bb].instructions) {
+                if (replacement[n] != no_value) continue;
+
+                auto v = f->value(n);
+                f->for_each_operand(v, [&](Value_Id &operand) {
+                    operand = resolve(operand);
+                });
+
+                if (has_side_effects(v)) {
+                    live[n] = 1;
+                    worklist.push_back(n);
+                }
+            }
+        }
+
+        while (worklist.size()) {
+            Value_Id n = worklist.back();
+            worklist.pop_back();
+
+            f->for_each_operand(f->value(n), [&](Value_Id &operand) {
+                if (!live[operand]) {
+                    live[operand] = 1;
+                    worklist.push_back(operand);
+                }
+            });
+        }
+
+        Array<u32> new_index(block_count, no_block);
+        u32 kept_count = 0;
+
+        // everything left is reachable, number it in reverse postorder
+        bool reordered = false;
+
+        for (auto bb : d->reverse_postorder) {
+            if (removed[bb]) continue;
+
+            if (bb != kept_count) reordered = true;
+            new_index[bb] = kept_count++;
+        }
+
+        Array<Basic_Block> kept(kept_count);
+
+        for (u32 bb = 0; bb < block_count; bb++) {
+            if (removed[bb]) continue;
+
+            auto &instructions = kept[new_index[bb]].instructions;
+
+            for (auto n : f->blocks[bb].instructions) {
+                if (!live[n]) continue;
+
+                auto v = f->value(n);
+
+                if (auto br = v->as<Branch>()) {
+                    br->true_target  = new_index[br->true_target];
+                    br->false_target = new_index[br->false_target];
+                } else if (auto jmp = v->as<Jump>()) {
+                    jmp->target = new_index[jmp->target];
+                } else if (auto phi = v->as<Phi>()) {
+                    for (u32 i = 0; i < phi->incoming_count; i++) {
+                        auto &incoming = f->phi_incoming[phi->first_incoming + i];
+                        incoming.block = new_index[incoming.block];
+                    }
+                }
+
+                instructions.push_back(n);
+            }
+
+            instruction_count -= instructions.size();
+            stats.instructions_after += instructions.size();
+        }
+
+        f->blocks.swap(kept);
+
+        // nothing dropped, nothing folded, then nothing changed
+        bool changed = instruction_count != 0 || kept_count != block_count || reordered ||
+                       stats.branches_folded != branches_folded_before;
+
+        if (changed) invalidate_analyses(f);
+
+        return changed;
+    }
+
+};
+
+internal void print_dead_code_stats(IL::Module *module) {
+    u32 total_before = 0, total_after = 0;
+
+    for (auto function : module->functions) {
+        auto &stats = function->dead_code;
+        String name = atom_table.name(function->ast->name);
+
+        total_before += stats.instructions_before;
+        total_after  += stats.instructions_after;
+
+        if (!stats.instructions_before) continue;
+
+        fprintf(stderr, "dce: %-24.*s %6u -> %6u instructions (%u blocks removed, %u merged, %u branches folded)\n",
+                (int)name.length, name.data,
+                stats.instructions_before, stats.instructions_after,
+                stats.blocks_removed, stats.blocks_merged, stats.branches_folded);
+    }
+
+    if (total_before) {
+        fprintf(stderr, "dce: %-24s %6u -> %6u instructions (%+.1f%%)\n", "total",
+                total_before, total_after,
+                100.0 * ((double)total_after - (double)total_before) / total_before);
+    }
+}
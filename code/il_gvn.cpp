@@ -0,0 +1,424 @@
+
+namespace IL {
+
+    /* @note
+     * Open addressing table of value numbers, keyed by whatever the caller
+     * hashes and compares. Entries are only ever removed in the reverse of
+     * the order they went in, so a removed slot can just be emptied: nothing
+     * that is still in the table probed past it on the way in.
+     */
+    struct Value_Table {
+        struct Slot {
+            u32 hash;
+            Value_Id value; // no_value if empty
+        };
+
+        Array<Slot> slots;
+        u32 mask;
+
+        void init(u32 max_entries) {
+            u32 capacity = 16;
+            while (capacity < max_entries * 2) capacity *= 2;
+
+            slots.assign(capacity, {0, no_value});
+            mask = capacity - 1;
+        }
+
+        // the value eq() accepts, or no_value with *slot_index where it would go
+        template <typename Eq>
+        Value_Id find(u32 hash, Eq eq, u32 *slot_index) {
+            u32 i = hash & mask;
+
+            while (slots[i].value != no_value) {
+                if (slots[i].hash == hash && eq(slots[i].value)) {
+                    return slots[i].value;
+                }
+                i = (i + 1) & mask;
+            }
+
+            *slot_index = i;
+            return no_value;
+        }
+
+        void insert(u32 slot_index, u32 hash, Value_Id n) {
+            slots[slot_index] = {hash, n};
+        }
+
+        void remove(u32 slot_index) {
+            slots[slot_index].value = no_value;
+        }
+    };
+
+    inline u32 hash_combine(u32 h, u32 v) {
+        return (h ^ v) * 16777619u; // FNV-1a, a word at a time
+    }
+
+    internal u32 hash_constant(u64 value) {
+        return hash_combine(hash_combine(2166136261u, (u32)value), (u32)(value >> 32));
+    }
+
+    internal u32 hash_expression(Value *v) {
+        u32 h = hash_combine(2166136261u, v->type);
+        h = hash_combine(h, (u32)(uintptr_t)v->value_type);
+
+        if (v->type == Value::BINARY_EXPRESSION) {
+            h = hash_combine(h, v->binary.op);
+            h = hash_combine(h, v->binary.lhs);
+            h = hash_combine(h, v->binary.rhs);
+        } else {
+            h = hash_combine(h, v->unary.op);
+            h = hash_combine(h, v->unary.operand);
+        }
+
+        return h;
+    }
+
+    internal bool same_expression(Value *a, Value *b) {
+        if (a->type != b->type || a->value_type != b->value_type) return false;
+
+        if (a->type == Value::BINARY_EXPRESSION) {
+            return a->binary.op  == b->binary.op
+                && a->binary.lhs == b->binary.lhs
+                && a->binary.rhs == b->binary.rhs;
+        }
+
+        return a->unary.op      == b->unary.op
+            && a->unary.operand == b->unary.operand;
+    }
+
+    // Folding wraps at the width of the operands, like the LLVM
+    // instructions they'd become. Only what the LLVM converter lowers is
+    // folded, anything else is left for it to complain about.
+    internal bool fold_binary(u32 op, u64 lhs, u64 rhs, u32 bits, u64 *result) {
+        u64 a = lhs, b = rhs;
+        i64 sa = sign_extend_bits(a, bits), sb = sign_extend_bits(b, bits);
+        i64 smallest = sign_extend_bits((u64)1 << (bits - 1), bits);
+
+        // division by zero and the smallest number / -1 are the program's
+        // problem, at run time, not ours now
+        bool divides = op == '/' || op == '%' ||
+                       op == Binary_Expression::UNSIGNED_DIV || op == Binary_Expression::UNSIGNED_MOD;
+        if (divides && (b == 0 || ((op == '/' || op == '%') && sa == smallest && sb == -1))) return false;
+
+        u64 r;
+        switch (op) {
+            case '+': r = a + b; break;
+            case '-': r = a - b; break;
+            case '*': r = a * b; break;
+            case '/': r = (u64)(sa / sb); break;
+            case '%': r = (u64)(sa % sb); break;
+            case '&': r = a & b; break;
+
+            // compares are i32 whatever they compare
+            case '<':                              *result = (sa < sb) ? 1 : 0; return true;
+            case Binary_Expression::UNSIGNED_LESS: *result = (a < b) ? 1 : 0;   return true;
+
+            case Binary_Expression::UNSIGNED_DIV: r = a / b; break;
+            case Binary_Expression::UNSIGNED_MOD: r = a % b; break;
+
+            // shift amounts past the width are poison in LLVM, leave them be
+            case Binary_Expression::SHIFT_LEFT:
+                if (b >= bits) return false;
+                r = a << b; break;
+            case Binary_Expression::SHIFT_RIGHT:
+                if (b >= bits) return false;
+                r = (u64)(sa >> b); break;
+            case Binary_Expression::UNSIGNED_SHIFT_RIGHT:
+                if (b >= bits) return false;
+                r = a >> b; break;
+
+            // reduce_strength only makes these of i32s
+            case Binary_Expression::MULTIPLY_HIGH:
+                if (bits > 32) return false;
+                r = (u64)((sa * sb) >> bits); break;
+            case Binary_Expression::UNSIGNED_MULTIPLY_HIGH:
+                if (bits > 32) return false;
+                r = (a * b) >> bits; break;
+
+            default:  return false;
+        }
+
+        *result = truncate_bits(r, bits);
+        return true;
+    }
+
+    // A conversion or negation of a constant, at the width of the result
+    internal bool fold_unary(u32 op, u64 operand, u32 operand_bits, u32 bits, u64 *result) {
+        switch (op) {
+            case '-':                           *result = truncate_bits(0 - operand, bits); return true;
+            case Unary_Expression::SIGN_EXTEND: *result = truncate_bits((u64)sign_extend_bits(operand, operand_bits), bits); return true;
+            case Unary_Expression::ZERO_EXTEND: *result = operand; return true;
+            case Unary_Expression::TRUNCATE:    *result = truncate_bits(operand, bits); return true;
+            default: return false;
+        }
+    }
+
+    internal bool is_commutative(u32 op) {
+        return op == '+' || op == '*' || op == '&' ||
+               op == Binary_Expression::MULTIPLY_HIGH || op == Binary_Expression::UNSIGNED_MULTIPLY_HIGH;
+    }
+
+    /* @note
+     * Dominator based value numbering, on SSA form (so after
+     * promote_allocas). Constants are hash-consed and all moved to the top
+     * of the entry block, where they dominate every use. Then a walk over
+     * the dominator tree folds binary and unary expressions of constants,
+     * drops phis whose incoming values are all the same, and replaces an
+     * expression with an identical one from a dominating block, keeping a
+     * scoped table of the expressions available on the way down.
+     * Calls, loads and stores are left alone, they aren't pure.
+     */
+    internal bool number_values(Function *f) {
+        if (f->blocks.empty()) return false;
+
+        auto &stats = f->value_numbering;
+        u32 changes_before = stats.constants_merged + stats.folded + stats.redundant + stats.phis_removed;
+
+        u32 instruction_count = 0;
+        for (auto &bb : f->blocks) instruction_count += bb.instructions.size();
+        if (!stats.runs++) stats.instructions_before = instruction_count;
+
+        Array<Value_Id> replacement(f->value_count(), no_value);
+
+        auto resolve = [&](Value_Id n) {
+            while (replacement[n] != no_value) n = replacement[n];
+            return n;
+        };
+
+        // hash-cons constants, in the order they first show up
+        Value_Table constants;
+        constants.init(f->value_count());
+
+        Array<Value_Id> entry_constants;
+
+        for (auto &bb : f->blocks) {
+            for (auto n : bb.instructions) {
+                auto c = f->value(n)->as<Constant>();
+                if (!c) continue;
+
+                u64 value = c->value;
+                auto type = f->value(n)->value_type;
+                u32 hash = hash_constant(value);
+                u32 slot;
+
+                Value_Id existing = constants.find(hash, [&](Value_Id other) {
+                    return f->value(other)->constant.value == value && f->value(other)->value_type == type;
+                }, &slot);
+
+                if (existing == no_value) {
+                    constants.insert(slot, hash, n);
+                    entry_constants.push_back(n);
+                } else {
+                    replacement[n] = existing;
+                    stats.constants_merged++;
+                }
+            }
+        }
+
+        // @note this grows f->values and replacement, so don't hold a
+        // Value * or a reference into replacement across it
+        auto get_constant = [&](u64 value, AST::Type *type) {
+            u32 hash = hash_constant(value);
+            u32 slot;
+
+            Value_Id n = constants.find(hash, [&](Value_Id other) {
+                return f->value(other)->constant.value == value && f->value(other)->value_type == type;
+            }, &slot);
+
+            if (n == no_value) {
+                Value v;
+                v.type = Value::CONSTANT;
+                v.value_type = type;
+                v.constant.value = value;
+
+                n = f->values.size();
+                f->values.push_back(v);
+                replacement.push_back(no_value);
+
+                constants.insert(slot, hash, n);
+                entry_constants.push_back(n);
+            }
+
+            return n;
+        };
+
+        auto constant_of = [&](Value_Id n, u64 *value) {
+            auto c = f->value(n)->as<Constant>();
+            if (c) *value = c->value;
+            return c != nullptr;
+        };
+
+        auto d = get_dominators(f);
+
+        Value_Table available;
+        available.init(f->value_count());
+
+        Array<u32> inserted; // slots of available, to undo on the way out
+
+        auto visit_block = [&](u32 bb) {
+            for (auto n : f->blocks[bb].instructions) {
+                f->for_each_operand(f->value(n), [&](Value_Id &operand) {
+                    operand = resolve(operand);
+                });
+
+                auto v = f->value(n);
+
+                if (v->type == Value::PHI) {
+                    Value_Id same = no_value;
+                    bool trivial = true;
+
+                    for (u32 i = 0; i < v->phi.incoming_count && trivial; i++) {
+                        Value_Id incoming = f->phi_incoming[v->phi.first_incoming + i].value;
+                        if (incoming == n || incoming == same) continue;
+
+                        if (same == no_value) same = incoming;
+                        else trivial = false;
+                    }
+
+                    if (trivial && same != no_value) {
+                        replacement[n] = same;
+                        stats.phis_removed++;
+                    }
+                    continue;
+                }
+
+                if (v->type != Value::BINARY_EXPRESSION && v->type != Value::UNARY_EXPRESSION) continue;
+
+                u64 lhs, rhs, result;
+
+                if (auto un = v->as<Unary_Expression>()) {
+                    if (un->op == '+') {
+                        replacement[n] = un->operand;
+                        stats.folded++;
+                        continue;
+                    }
+
+                    u32 operand_bits = type_bits(f->value(un->operand)->value_type);
+                    if (constant_of(un->operand, &rhs) &&
+                        fold_unary(un->op, rhs, operand_bits, type_bits(v->value_type), &result)) {
+                        Value_Id folded = get_constant(result, v->value_type);
+                        replacement[n] = folded;
+                        stats.folded++;
+                        continue;
+                    }
+                } else {
+                    auto bi = v->as<Binary_Expression>();
+
+                    u32 bits = type_bits(f->value(bi->lhs)->value_type);
+                    if (constant_of(bi->lhs, &lhs) && constant_of(bi->rhs, &rhs) &&
+                        fold_binary(bi->op, lhs, rhs, bits, &result)) {
+                        Value_Id folded = get_constant(result, v->value_type);
+                        replacement[n] = folded;
+                        stats.folded++;
+                        continue;
+                    }
+
+                    if (is_commutative(bi->op) && bi->lhs > bi->rhs) {
+                        std::swap(bi->lhs, bi->rhs);
+                    }
+                }
+
+                v = f->value(n);
+
+                u32 hash = hash_expression(v);
+                u32 slot;
+
+                Value_Id existing = available.find(hash, [&](Value_Id other) {
+                    return same_expression(f->value(other), v);
+                }, &slot);
+
+                if (existing != no_value) {
+                    replacement[n] = existing;
+                    stats.redundant++;
+                } else {
+                    available.insert(slot, hash, n);
+                    inserted.push_back(slot);
+                }
+            }
+        };
+
+        struct Walk { u32 bb; u32 inserted_before; bool leaving; };
+        Array<Walk> walk;
+        walk.push_back({0, 0, false});
+
+        while (walk.size()) {
+            auto item = walk.back();
+            walk.pop_back();
+
+            if (item.leaving) {
+                while (inserted.size() > item.inserted_before) {
+                    available.remove(inserted.back());
+                    inserted.pop_back();
+                }
+                continue;
+            }
+
+            walk.push_back({item.bb, (u32)inserted.size(), true});
+            visit_block(item.bb);
+
+            for (auto child : d->children[item.bb]) {
+                walk.push_back({child, 0, false});
+            }
+        }
+
+        // unreachable blocks still get their operands rewritten below, but
+        // nothing in them is numbered against the rest
+
+        // constants first, drop whatever was replaced, and catch the uses
+        // (phis on back edges) that were visited before what they use
+        for (u32 bb = 0; bb < f->blocks.size(); bb++) {
+            auto &instructions = f->blocks[bb].instructions;
+
+            Array<Value_Id> kept;
+            if (bb == 0) kept = entry_constants;
+
+            for (auto n : instructions) {
+                if (replacement[n] != no_value) continue;
+                if (f->value(n)->type == Value::CONSTANT) continue; // already in kept
+
+                kept.push_back(n);
+            }
+
+            for (auto n : kept) {
+                f->for_each_operand(f->value(n), [&](Value_Id &operand) {
+                    operand = resolve(operand);
+                });
+            }
+
+            instructions.swap(kept);
+        }
+
+        stats.instructions_after = 0;
+        for (auto &bb : f->blocks) stats.instructions_after += bb.instructions.size();
+
+        invalidate_analyses(f, Analyses::CFG_EDGES | Analyses::DOMINATORS | Analyses::LOOPS);
+
+        return stats.constants_merged + stats.folded + stats.redundant + stats.phis_removed != changes_before;
+    }
+
+};
+
+internal void print_value_numbering_stats(IL::Module *module) {
+    u32 total_before = 0, total_after = 0;
+
+    for (auto function : module->functions) {
+        auto &stats = function->value_numbering;
+        String name = atom_table.name(function->ast->name);
+
+        total_before += stats.instructions_before;
+        total_after  += stats.instructions_after;
+
+        if (!stats.instructions_before) continue;
+
+        fprintf(stderr, "gvn: %-24.*s %6u -> %6u instructions (%u constants merged, %u folded, %u redundant, %u phis)\n",
+                (int)name.length, name.data,
+                stats.instructions_before, stats.instructions_after,
+                stats.constants_merged, stats.folded, stats.redundant, stats.phis_removed);
+    }
+
+    if (total_before) {
+        fprintf(stderr, "gvn: %-24s %6u -> %6u instructions (%+.1f%%)\n", "total",
+                total_before, total_after,
+                100.0 * ((double)total_after - (double)total_before) / total_before);
+    }
+}
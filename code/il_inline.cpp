@@ -0,0 +1,320 @@
+
+namespace IL {
+
+    // Callees up to this many instructions are inlined without being asked,
+    // more of them inside a loop, where the call costs every iteration.
+    const u32 inline_threshold      = 40;
+    const u32 loop_inline_threshold = 120;
+
+    // Past this a caller only gets what @inline forces into it
+    const u32 max_inlined_caller_size = 4000;
+
+    // Roughly how much code a function turns into. Constants, arguments and
+    // phis mostly end up in registers and operands.
+    internal u32 inline_cost(Function *f) {
+        u32 cost = 0;
+
+        for (auto &bb : f->blocks) {
+            for (auto n : bb.instructions) {
+                auto type = f->value(n)->type;
+
+                if (type == Value::CONSTANT || type == Value::UNDEF ||
+                    type == Value::ARGUMENT || type == Value::PHI) continue;
+
+                cost++;
+            }
+        }
+
+        return cost;
+    }
+
+    /* @note
+     * Replaces the call at position in bb with a copy of callee's blocks.
+     * Everything after the call moves to a new continuation block, bb jumps
+     * to the copy of the callee's entry, and each of its returns jumps to
+     * the continuation, which merges the returned values with a phi.
+     * Arguments become the values passed in. Uses of the call's result are
+     * redirected through replacement, the caller resolves them afterwards.
+     * The copies take the block numbers after the continuation.
+     */
+    internal u32 inline_call(Function *f, u32 bb, u32 position, Function *callee,
+                             Array<Value_Id> &replacement) {
+        Value_Id call_n = f->blocks[bb].instructions[position];
+        auto call = f->value(call_n)->as<Function_Call>();
+        assert(call);
+
+        Array<Value_Id> call_arguments;
+        for (auto argument : f->call_arguments(call)) call_arguments.push_back(argument);
+
+        u32 continuation = f->insert_block();
+
+        {
+            auto &instructions = f->blocks[bb].instructions;
+            f->blocks[continuation].instructions.assign(instructions.begin() + position + 1, instructions.end());
+            instructions.resize(position);
+        }
+
+        // edges out of bb leave from the continuation now
+        if (auto term = terminator(f, continuation)) {
+            u32 successors[2] = {no_block, no_block};
+
+            if (term->type == Value::BRANCH) {
+                successors[0] = term->branch.true_target;
+                successors[1] = term->branch.false_target;
+            } else if (term->type == Value::JUMP) {
+                successors[0] = term->jump.target;
+            }
+
+            for (u32 s : successors) {
+                if (s == no_block) continue;
+
+                for (auto n : f->blocks[s].instructions) {
+                    auto phi = f->value(n)->as<Phi>();
+                    if (!phi) continue;
+
+                    for (u32 i = 0; i < phi->incoming_count; i++) {
+                        auto &incoming = f->phi_incoming[phi->first_incoming + i];
+                        if (incoming.block == bb) incoming.block = continuation;
+                    }
+                }
+            }
+        }
+
+        u32 first_block = f->blocks.size();
+        for (u32 i = 0; i < callee->blocks.size(); i++) f->insert_block();
+
+        // copy every value first, so operands can be mapped whatever order
+        // they're defined in (phis on back edges use later values)
+        Array<Value_Id> value_map(callee->value_count(), no_value);
+
+        for (u32 callee_bb = 0; callee_bb < callee->blocks.size(); callee_bb++) {
+            for (auto n : callee->blocks[callee_bb].instructions) {
+                Value v = *callee->value(n);
+
+                if (auto arg = v.as<Argument>()) {
+                    assert(arg->index < call_arguments.size() && "call with too few arguments");
+                    value_map[n] = call_arguments[arg->index];
+                    continue;
+                }
+
+                if (auto inner_call = v.as<Function_Call>()) {
+                    u32 first = f->arguments.size();
+                    for (auto argument : callee->call_arguments(inner_call)) f->arguments.push_back(argument);
+                    inner_call->first_argument = first;
+                } else if (auto phi = v.as<Phi>()) {
+                    u32 first = f->phi_incoming.size();
+                    for (u32 i = 0; i < phi->incoming_count; i++) {
+                        f->phi_incoming.push_back(callee->phi_incoming[phi->first_incoming + i]);
+                    }
+                    phi->first_incoming = first;
+                }
+
+                Value_Id copy = f->values.size();
+                f->values.push_back(v);
+                value_map[n] = copy;
+
+                // allocas stay in the entry block, a loop around the call
+                // mustn't grow the stack
+                auto &instructions = (v.type == Value::ALLOCA) ? f->blocks[0].instructions
+                                                               : f->blocks[first_block + callee_bb].instructions;
+                if (v.type == Value::ALLOCA) instructions.insert(instructions.begin(), copy);
+                else                         instructions.push_back(copy);
+            }
+        }
+
+        struct Returned { Value_Id value; u32 block; };
+        Array<Returned> returned;
+
+        for (u32 callee_bb = 0; callee_bb < callee->blocks.size(); callee_bb++) {
+            u32 copy_bb = first_block + callee_bb;
+
+            for (auto n : callee->blocks[callee_bb].instructions) {
+                if (callee->value(n)->type == Value::ARGUMENT) continue;
+
+                auto v = f->value(value_map[n]);
+
+                f->for_each_operand(v, [&](Value_Id &operand) {
+                    assert(value_map[operand] != no_value && "operand defined outside any block");
+                    operand = value_map[operand];
+                });
+
+                if (auto br = v->as<Branch>()) {
+                    br->true_target  += first_block;
+                    br->false_target += first_block;
+                } else if (auto jmp = v->as<Jump>()) {
+                    jmp->target += first_block;
+                } else if (auto phi = v->as<Phi>()) {
+                    for (u32 i = 0; i < phi->incoming_count; i++) {
+                        f->phi_incoming[phi->first_incoming + i].block += first_block;
+                    }
+                } else if (auto ret = v->as<Return>()) {
+                    returned.push_back({ret->return_value, copy_bb});
+
+                    v->type = Value::JUMP;
+                    v->jump.target = continuation;
+                }
+            }
+        }
+
+        f->insert_jump(bb, first_block);
+
+        // the result, if anything uses it
+        Value_Id result = no_value;
+
+        if (returned.empty()) {
+            // never returns, the continuation is unreachable but still has
+            // to make sense until dead code elimination drops it
+            Value v;
+            v.type = Value::UNDEF;
+            v.value_type = f->value(call_n)->value_type;
+
+            result = f->values.size();
+            f->values.push_back(v);
+
+            auto &instructions = f->blocks[continuation].instructions;
+            instructions.insert(instructions.begin(), result);
+        } else if (returned.size() == 1) {
+            result = returned[0].value;
+        } else if (returned.size() > 1 && returned[0].value != no_value) {
+            result = add_phi(f, returned.size(), f->value(call_n)->value_type);
+
+            auto phi = f->value(result)->as<Phi>();
+            for (u32 i = 0; i < returned.size(); i++) {
+                f->phi_incoming[phi->first_incoming + i] = {returned[i].value, returned[i].block};
+            }
+
+            auto &instructions = f->blocks[continuation].instructions;
+            instructions.insert(instructions.begin(), result);
+        }
+
+        replacement.resize(f->value_count(), no_value);
+        if (result != no_value) replacement[call_n] = result;
+
+        invalidate_analyses(f);
+
+        return continuation;
+    }
+
+    /* @note
+     * Functions are done callees first (postorder over the call graph), so
+     * what gets copied into a caller has had its own calls inlined already.
+     * A call is only inlined into a caller if the callee came first, which
+     * leaves calls around a recursive cycle alone. Copied blocks aren't
+     * looked at again: the calls left in them were already turned down.
+     * With forced_only set, only @inline callees are inlined.
+     */
+    internal u32 inline_calls(Module *m, bool forced_only) {
+        u32 function_count = m->functions.size();
+
+        Call_Graph cg;
+        build_call_graph(m, &cg);
+
+        Array<u8> done(function_count, 0);
+        Array<u32> cost(function_count, 0);
+
+        Array<Value_Id> replacement;
+        Array<u8> copied;       // blocks copied from a callee, by block index
+        Array<u32> loop_depth;  // by block index
+
+        u32 changed_count = 0;
+
+        for (auto index : cg.postorder) {
+            auto f = m->functions[index];
+            done[index] = 1;
+
+            if (f->blocks.empty()) continue;
+
+            u32 caller_size = inline_cost(f);
+            bool changed = false;
+
+            replacement.assign(f->value_count(), no_value);
+            copied.assign(f->blocks.size(), 0);
+            loop_depth.assign(f->blocks.size(), 0);
+
+            if (!forced_only) {
+                auto nest = get_loops(f);
+                for (u32 bb = 0; bb < f->blocks.size(); bb++) {
+                    u32 loop = nest->loop_of[bb];
+                    if (loop != no_loop) loop_depth[bb] = nest->loops[loop].depth;
+                }
+            }
+
+            for (u32 bb = 0; bb < f->blocks.size(); bb++) {
+                if (copied[bb]) continue;
+
+                auto &instructions = f->blocks[bb].instructions;
+
+                for (u32 i = 0; i < instructions.size(); i++) {
+                    auto call = f->value(instructions[i])->as<Function_Call>();
+                    if (!call) continue;
+
+                    u32 callee_index = call->callee;
+                    if (callee_index == index || !done[callee_index]) continue;
+
+                    auto callee = m->functions[callee_index];
+                    if (callee->blocks.empty()) continue; // declarations
+
+                    auto inlining = callee->ast->inlining;
+                    u32 callee_cost = cost[callee_index];
+
+                    bool inline_it;
+                    if (inlining == AST::Function::INLINE_NEVER) {
+                        inline_it = false;
+                    } else if (inlining == AST::Function::INLINE_ALWAYS) {
+                        inline_it = true;
+                    } else if (forced_only) {
+                        inline_it = false;
+                    } else {
+                        u32 threshold = loop_depth[bb] ? loop_inline_threshold : inline_threshold;
+                        inline_it = callee_cost <= threshold &&
+                                    caller_size + callee_cost <= max_inlined_caller_size;
+                    }
+
+                    if (!inline_it) continue;
+
+                    u32 depth = loop_depth[bb];
+                    u32 continuation = inline_call(f, bb, i, callee, replacement);
+
+                    copied.resize(f->blocks.size(), 1);
+                    copied[continuation] = 0;
+                    loop_depth.resize(f->blocks.size(), depth);
+
+                    caller_size += callee_cost;
+                    changed = true;
+                    break; // the rest of the block is in the continuation now
+                }
+            }
+
+            if (changed) {
+                auto resolve = [&](Value_Id n) {
+                    while (replacement[n] != no_value) n = replacement[n];
+                    return n;
+                };
+
+                for (auto &bb : f->blocks) {
+                    for (auto n : bb.instructions) {
+                        f->for_each_operand(f->value(n), [&](Value_Id &operand) {
+                            operand = resolve(operand);
+                        });
+                    }
+                }
+
+                invalidate_analyses(f);
+                changed_count++;
+            }
+
+            cost[index] = inline_cost(f);
+        }
+
+        return changed_count;
+    }
+
+    internal u32 inline_calls(Module *m) {
+        return inline_calls(m, false);
+    }
+
+    internal u32 inline_forced_calls(Module *m) {
+        return inline_calls(m, true);
+    }
+
+};
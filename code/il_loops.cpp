@@ -0,0 +1,418 @@
+
+namespace IL {
+
+    // the most header instructions rotate_loops copies into the guard
+    const u32 max_rotated_header_size = 16;
+
+    struct Rotation {
+        u32 preheader;   // the one block outside the loop that jumps to the header
+        u32 header;
+        u32 body;        // the header's successor in the loop
+        u32 exit;        // and out of it
+    };
+
+    internal Value_Id clone_value(Function *f, Value_Id n) {
+        Value v = *f->value(n);
+
+        if (v.type == Value::FUNCTION_CALL) {
+            u32 first = f->arguments.size();
+            for (u32 i = 0; i < v.call.argument_count; i++) {
+                f->arguments.push_back(f->arguments[v.call.first_argument + i]);
+            }
+            v.call.first_argument = first;
+        }
+
+        f->values.push_back(v);
+        return f->values.size() - 1;
+    }
+
+    internal Value_Id add_phi(Function *f, u32 incoming_count, AST::Type *type) {
+        Value v;
+        v.type = Value::PHI;
+        v.value_type = type;
+        v.phi.first_incoming = f->phi_incoming.size();
+        v.phi.incoming_count = incoming_count;
+
+        f->phi_incoming.resize(f->phi_incoming.size() + incoming_count, {no_value, no_block});
+        f->values.push_back(v);
+        return f->values.size() - 1;
+    }
+
+    // Whether the loop is a while loop as convert_block makes them, with the
+    // condition in the header and nothing but the header leaving the loop.
+    internal bool find_rotation(Function *f, CFG *cfg, Loop *loop, Array<u32> &member, u32 loop_index, Rotation *r) {
+        u32 header = loop->header;
+        if (loop->latches.size() != 1) return false;
+
+        auto &header_instructions = f->blocks[header].instructions;
+        if (header_instructions.empty()) return false;
+
+        auto latch_term = terminator(f, loop->latches[0]);
+        if (!latch_term || latch_term->type != Value::JUMP) return false;
+
+        auto br = f->value(header_instructions.back())->as<Branch>();
+        if (!br) return false;
+
+        bool true_in  = member[br->true_target]  == loop_index;
+        bool false_in = member[br->false_target] == loop_index;
+        if (true_in == false_in) return false;
+
+        r->header = header;
+        r->body   = true_in ? br->true_target  : br->false_target;
+        r->exit   = true_in ? br->false_target : br->true_target;
+
+        if (r->body == header) return false;
+        if (cfg->predecessors[r->body].size() != 1 || cfg->predecessors[r->exit].size() != 1) return false;
+
+        // a return in the body leaves from elsewhere, and what it uses from
+        // the header would have to be the body's phi rather than the exit's
+        for (auto bb : loop->blocks) {
+            if (bb == header) continue;
+
+            for (auto s : cfg->successors[bb]) {
+                if (member[s] != loop_index) return false;
+            }
+        }
+
+        r->preheader = no_block;
+        for (auto p : cfg->predecessors[header]) {
+            if (member[p] == loop_index) continue;
+            if (r->preheader != no_block) return false;
+            r->preheader = p;
+        }
+        if (r->preheader == no_block) return false;
+
+        auto pre_term = terminator(f, r->preheader);
+        if (!pre_term || pre_term->type != Value::JUMP) return false;
+
+        u32 copied = 0;
+        for (auto n : header_instructions) {
+            auto type = f->value(n)->type;
+            if (type != Value::PHI && type != Value::BRANCH) copied++;
+            if (type == Value::BRANCH && n != header_instructions.back()) return false;
+        }
+
+        return copied <= max_rotated_header_size;
+    }
+
+    /* @note
+     * Rotates while loops into a guarded do-while:
+     *
+     *     P: jmp H                      P: H' (copy of H), br c' ? PH : X
+     *     H: phis, c, br c ? B : X      PH: jmp B
+     *     B: ... L: jmp H        =>     B: phis, ... L: jmp H
+     *     X: ...                        H: c, br c ? B : X
+     *                                   X: phis, ...
+     *
+     * The copy in the preheader decides whether the loop runs at all, and
+     * the old header now ends each iteration. It has the latch as its only
+     * predecessor, so eliminate_dead_code merges them and the loop takes one
+     * branch per iteration instead of two. PH is a preheader that only
+     * runs if the loop does, for hoist_loop_invariants.
+     *
+     * Every value of the old header gets a phi in B (the copy's value or
+     * the one from the previous iteration) for uses in the loop, and one in
+     * X for uses after it. The header's own phis become the value coming in
+     * from the latch. Phis nobody ends up using are left to
+     * eliminate_dead_code.
+     */
+    internal bool rotate_loops(Function *f) {
+        if (f->blocks.empty()) return false;
+
+        auto cfg  = get_cfg(f);
+        auto nest = get_loops(f);
+
+        u32 block_count = f->blocks.size();
+
+        Array<u32> member(block_count, no_loop);
+        Array<Rotation> rotations;
+        Array<Array<u8>> in_loop; // for each rotation, by block
+
+        // inner loops first; a rotation only changes the edges around its
+        // own loop, so the others found here stay valid
+        for (u32 i = nest->loops.size(); i-- > 0;) {
+            auto loop = &nest->loops[i];
+            for (auto bb : loop->blocks) member[bb] = i;
+
+            Rotation r;
+            if (!find_rotation(f, cfg, loop, member, i, &r)) continue;
+
+            rotations.push_back(r);
+            in_loop.emplace_back(block_count, 0);
+            for (auto bb : loop->blocks) in_loop.back()[bb] = 1;
+        }
+
+        if (rotations.empty()) return false;
+
+        Array<u32> block_of(f->value_count(), no_block);
+        for (u32 bb = 0; bb < block_count; bb++) {
+            for (auto n : f->blocks[bb].instructions) block_of[n] = bb;
+        }
+
+        // by value of the header, reset after each loop
+        Array<Value_Id> copied, in_body, after_loop;
+
+        for (u32 ri = 0; ri < rotations.size(); ri++) {
+            auto r = rotations[ri];
+            auto &loop_blocks = in_loop[ri];
+
+            u32 new_preheader = f->insert_block();
+            loop_blocks.push_back(0);
+
+            u32 first_new_value = f->value_count();
+
+            Array<Value_Id> header_values = f->blocks[r.header].instructions;
+            header_values.pop_back(); // the branch
+            Value_Id header_branch = f->blocks[r.header].instructions.back();
+
+            copied.resize(first_new_value, no_value);
+            in_body.resize(first_new_value, no_value);
+            after_loop.resize(first_new_value, no_value);
+
+            auto latch_value = [&](Value_Id phi_n) -> Value_Id {
+                auto phi = f->value(phi_n)->as<Phi>();
+                for (u32 i = 0; i < phi->incoming_count; i++) {
+                    auto incoming = f->phi_incoming[phi->first_incoming + i];
+                    if (incoming.block != r.preheader) return incoming.value;
+                }
+                assert(false && "loop header phi without a latch");
+                return no_value;
+            };
+
+            // the guard, a copy of the header with its phis at their first value
+            f->blocks[r.preheader].instructions.pop_back(); // jmp header
+
+            for (auto n : header_values) {
+                if (auto phi = f->value(n)->as<Phi>()) {
+                    for (u32 i = 0; i < phi->incoming_count; i++) {
+                        auto incoming = f->phi_incoming[phi->first_incoming + i];
+                        if (incoming.block == r.preheader) copied[n] = incoming.value;
+                    }
+                    continue;
+                }
+
+                Value_Id copy = clone_value(f, n);
+                f->for_each_operand(f->value(copy), [&](Value_Id &operand) {
+                    if (block_of[operand] == r.header) operand = copied[operand];
+                });
+
+                f->blocks[r.preheader].instructions.push_back(copy);
+                copied[n] = copy;
+            }
+
+            {
+                auto br = f->value(header_branch)->branch;
+                Value_Id condition = (block_of[br.condition] == r.header) ? copied[br.condition] : br.condition;
+
+                f->insert_branch(r.preheader, condition,
+                                 (br.true_target  == r.body) ? new_preheader : r.exit,
+                                 (br.false_target == r.body) ? new_preheader : r.exit);
+            }
+
+            f->insert_jump(new_preheader, r.body);
+
+            // phis for the header's values in the body and after the loop
+            for (auto n : header_values) {
+                in_body[n]    = add_phi(f, 2, f->value(n)->value_type);
+                after_loop[n] = add_phi(f, 2, f->value(n)->value_type);
+            }
+
+            u32 first_unused = f->value_count();
+
+            auto in_loop_value = [&](Value_Id n) {
+                return (n < first_new_value && block_of[n] == r.header) ? in_body[n] : n;
+            };
+
+            // what a header value is at the end of the header, from now on
+            auto end_of_header = [&](Value_Id n) {
+                return f->value(n)->type == Value::PHI ? in_loop_value(latch_value(n)) : n;
+            };
+
+            Array<Value_Id> body_phis, exit_phis;
+
+            for (auto n : header_values) {
+                auto set = [&](Value_Id phi_n, u32 entry_block) {
+                    auto phi = f->value(phi_n)->phi;
+                    f->phi_incoming[phi.first_incoming + 0] = {copied[n], entry_block};
+                    f->phi_incoming[phi.first_incoming + 1] = {end_of_header(n), r.header};
+                };
+
+                set(in_body[n], new_preheader);
+                set(after_loop[n], r.preheader);
+
+                body_phis.push_back(in_body[n]);
+                exit_phis.push_back(after_loop[n]);
+            }
+
+            // uses of the header's values
+            for (u32 bb = 0; bb < block_count; bb++) {
+                if (bb == r.preheader) continue;
+
+                for (auto n : f->blocks[bb].instructions) {
+                    if (n >= first_new_value && n < first_unused) continue; // done above
+
+                    // going away, and end_of_header reads them
+                    if (bb == r.header && f->value(n)->type == Value::PHI) continue;
+
+                    f->for_each_operand(f->value(n), [&](Value_Id &operand) {
+                        if (operand >= first_new_value || block_of[operand] != r.header) return;
+
+                        if (bb == r.header) {
+                            operand = end_of_header(operand);
+                        } else if (loop_blocks[bb]) {
+                            operand = in_body[operand];
+                        } else {
+                            operand = after_loop[operand];
+                        }
+                    });
+                }
+            }
+
+            // the header keeps its instructions but not its phis
+            auto &header_instructions = f->blocks[r.header].instructions;
+            header_instructions.erase(std::remove_if(header_instructions.begin(), header_instructions.end(),
+                                                     [&](Value_Id n) { return f->value(n)->type == Value::PHI; }),
+                                      header_instructions.end());
+
+            auto &body = f->blocks[r.body].instructions;
+            body.insert(body.begin(), body_phis.begin(), body_phis.end());
+
+            auto &exit = f->blocks[r.exit].instructions;
+            exit.insert(exit.begin(), exit_phis.begin(), exit_phis.end());
+
+            // keep block_of up to date for the loops still to rotate
+            block_of.resize(f->value_count(), no_block);
+            for (auto n : f->blocks[r.preheader].instructions) block_of[n] = r.preheader;
+            for (auto n : f->blocks[new_preheader].instructions) block_of[n] = new_preheader;
+            for (auto n : body_phis) block_of[n] = r.body;
+            for (auto n : exit_phis) block_of[n] = r.exit;
+
+            for (auto n : header_values) {
+                if (f->value(n)->type == Value::PHI) block_of[n] = no_block;
+                copied[n] = in_body[n] = after_loop[n] = no_value;
+            }
+
+            // the new preheader is in whatever loops the old one is in
+            for (u32 other = ri + 1; other < rotations.size(); other++) {
+                in_loop[other].push_back(in_loop[other][r.preheader]);
+            }
+            block_count = f->blocks.size();
+        }
+
+        invalidate_analyses(f);
+        return true;
+    }
+
+    internal bool may_trap(Value *v) {
+        auto bi = v->as<Binary_Expression>();
+        return bi && (bi->op == '/' || bi->op == '%' ||
+                      bi->op == Binary_Expression::UNSIGNED_DIV || bi->op == Binary_Expression::UNSIGNED_MOD);
+    }
+
+    /* @note
+     * Loop-invariant code motion: arithmetic whose operands are all defined
+     * outside a loop moves to the end of the loop's preheader, and so do
+     * loads when nothing in the loop stores or calls. Inner loops go first,
+     * so an expression can move out of several loops one after the other.
+     * The preheader is the one block outside the loop jumping to the
+     * header. When rotate_loops made it, it only runs if the loop does;
+     * otherwise what moves there may run when it wouldn't have, which is
+     * why nothing that can trap is moved.
+     */
+    internal bool hoist_loop_invariants(Function *f) {
+        if (f->blocks.empty()) return false;
+
+        auto cfg  = get_cfg(f);
+        auto d    = get_dominators(f);
+        auto nest = get_loops(f);
+
+        u32 block_count = f->blocks.size();
+
+        Array<u32> block_of(f->value_count(), no_block);
+        for (u32 bb = 0; bb < block_count; bb++) {
+            for (auto n : f->blocks[bb].instructions) block_of[n] = bb;
+        }
+
+        Array<u32> member(block_count, no_loop);
+        Array<u32> ordered;
+        Array<Value_Id> hoisted;
+        bool changed = false;
+
+        for (u32 i = nest->loops.size(); i-- > 0;) {
+            auto loop = &nest->loops[i];
+            for (auto bb : loop->blocks) member[bb] = i;
+
+            u32 preheader = no_block;
+            bool single = true;
+
+            for (auto p : cfg->predecessors[loop->header]) {
+                if (member[p] == i) continue;
+                if (preheader != no_block && preheader != p) single = false;
+                preheader = p;
+            }
+
+            if (!single || preheader == no_block) continue;
+
+            auto &pre_instructions = f->blocks[preheader].instructions;
+            if (pre_instructions.empty() || f->value(pre_instructions.back())->type != Value::JUMP) continue;
+
+            bool writes_memory = false;
+            for (auto bb : loop->blocks) {
+                for (auto n : f->blocks[bb].instructions) {
+                    auto type = f->value(n)->type;
+                    if (type == Value::STORE || type == Value::FUNCTION_CALL) writes_memory = true;
+                }
+            }
+
+            auto invariant = [&](Value_Id n) {
+                auto v = f->value(n);
+
+                bool movable = v->type == Value::BINARY_EXPRESSION ||
+                               v->type == Value::UNARY_EXPRESSION ||
+                               (v->type == Value::LOAD && !writes_memory);
+                if (!movable || may_trap(v)) return false;
+
+                bool outside = true;
+                f->for_each_operand(v, [&](Value_Id &operand) {
+                    if (block_of[operand] != no_block && member[block_of[operand]] == i) outside = false;
+                });
+                return outside;
+            };
+
+            // operands come before their uses in reverse postorder
+            ordered = loop->blocks;
+            std::sort(ordered.begin(), ordered.end(), [&](u32 a, u32 b) {
+                return d->rpo_index[a] < d->rpo_index[b];
+            });
+
+            hoisted.clear();
+
+            for (auto bb : ordered) {
+                auto &instructions = f->blocks[bb].instructions;
+                u32 kept = 0;
+
+                for (auto n : instructions) {
+                    if (invariant(n)) {
+                        hoisted.push_back(n);
+                        block_of[n] = preheader;
+                    } else {
+                        instructions[kept++] = n;
+                    }
+                }
+
+                instructions.resize(kept);
+            }
+
+            if (hoisted.empty()) continue;
+
+            pre_instructions.insert(pre_instructions.end() - 1, hoisted.begin(), hoisted.end());
+            changed = true;
+        }
+
+        // instructions moved, the blocks and edges stay
+        if (changed) invalidate_analyses(f, Analyses::CFG_EDGES | Analyses::DOMINATORS | Analyses::LOOPS);
+
+        return changed;
+    }
+
+};
@@ -0,0 +1,128 @@
+
+namespace IL {
+
+    internal u32 count_instructions(Function *f) {
+        u32 count = 0;
+        for (auto &bb : f->blocks) count += bb.instructions.size();
+        return count;
+    }
+
+    internal u64 count_instructions(Module *m) {
+        u64 count = 0;
+        for (auto f : m->functions) count += count_instructions(f);
+        return count;
+    }
+
+    internal void add_function_pass(Pass_Manager *pm, const char *name, Function_Pass function_pass) {
+        Pass pass = {};
+        pass.name = name;
+        pass.function_pass = function_pass;
+
+        pm->passes.push_back(pass);
+        if (pm->first_module_pass == pm->passes.size() - 1) pm->first_module_pass++;
+    }
+
+    internal void add_module_pass(Pass_Manager *pm, const char *name, Module_Pass module_pass) {
+        Pass pass = {};
+        pass.name = name;
+        pass.module_pass = module_pass;
+
+        pm->passes.push_back(pass);
+    }
+
+    // has_forced_inlines: something in the module asks for @inline. -O0
+    // doesn't inline anything else, and keeps the pipelined front end
+    // when there's nothing to inline.
+    internal void build_pipeline(Pass_Manager *pm, u32 optimization_level, bool has_forced_inlines) {
+        pm->passes.clear();
+        pm->first_module_pass = 0;
+
+        // even -O0 keeps locals in registers, LLVM is much quicker on SSA
+        add_function_pass(pm, "ssa", promote_allocas);
+
+        if (optimization_level >= 1) {
+            add_function_pass(pm, "gvn", number_values);
+            add_function_pass(pm, "dce", eliminate_dead_code); // callees are costed and copied clean
+            add_module_pass(pm, "inline", inline_calls);
+            add_module_pass(pm, "globaldce", eliminate_dead_functions); // helpers inlined everywhere
+            add_function_pass(pm, "gvn", number_values);
+            add_function_pass(pm, "dce", eliminate_dead_code);
+            add_function_pass(pm, "rotate", rotate_loops);
+            add_function_pass(pm, "licm", hoist_loop_invariants);
+            add_function_pass(pm, "gvn", number_values);       // folds guards of loops that always run
+            add_function_pass(pm, "ranges", propagate_ranges);
+            add_function_pass(pm, "strength", reduce_strength);
+            add_function_pass(pm, "gvn", number_values);       // x / d and x % d share the quotient
+            add_function_pass(pm, "dce", eliminate_dead_code); // merges rotated headers into latches
+            add_module_pass(pm, "attrs", infer_function_attributes);
+        } else if (has_forced_inlines) {
+            add_module_pass(pm, "inline", inline_forced_calls);
+        }
+    }
+
+    internal double seconds_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    internal void run_pass_on_function(Pass *pass, Function *f) {
+        if (f->blocks.empty()) return; // declarations
+
+        u32 before = count_instructions(f);
+
+        auto start = std::chrono::steady_clock::now();
+        bool changed = pass->function_pass(f);
+        pass->seconds += seconds_since(start);
+
+        pass->runs++;
+        pass->instructions_before += before;
+        pass->instructions_after  += count_instructions(f);
+        if (changed) pass->functions_changed++;
+    }
+
+    internal void run_function_passes(Pass_Manager *pm, Function *f) {
+        for (u32 i = 0; i < pm->first_module_pass; i++) {
+            run_pass_on_function(&pm->passes[i], f);
+        }
+    }
+
+    internal void run_module_passes(Pass_Manager *pm, Module *m) {
+        for (u32 i = pm->first_module_pass; i < pm->passes.size(); i++) {
+            auto pass = &pm->passes[i];
+
+            if (pass->function_pass) {
+                for (auto f : m->functions) run_pass_on_function(pass, f);
+                continue;
+            }
+
+            u64 before = count_instructions(m);
+
+            auto start = std::chrono::steady_clock::now();
+            u32 changed = pass->module_pass(m);
+            pass->seconds += seconds_since(start);
+
+            pass->runs++;
+            pass->instructions_before += before;
+            pass->instructions_after  += count_instructions(m);
+            pass->functions_changed   += changed;
+        }
+    }
+
+};
+
+internal void print_pass_stats(IL::Pass_Manager *pm) {
+    fprintf(stderr, "%-12s %8s %8s %10s %12s %12s\n",
+            "pass", "runs", "changed", "time (ms)", "before", "after");
+
+    double total_seconds = 0;
+
+    for (auto &pass : pm->passes) {
+        fprintf(stderr, "%-12s %8u %8u %10.3f %12llu %12llu\n",
+                pass.name, pass.runs, pass.functions_changed, pass.seconds * 1000.0,
+                (unsigned long long)pass.instructions_before,
+                (unsigned long long)pass.instructions_after);
+
+        total_seconds += pass.seconds;
+    }
+
+    fprintf(stderr, "%-12s %8s %8s %10.3f\n", "total", "", "", total_seconds * 1000.0);
+}
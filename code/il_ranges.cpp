@@ -0,0 +1,522 @@
+
+namespace IL {
+
+    // How far up the dominator tree refined_range looks for branches, so very
+    // deeply nested code doesn't make every query slow
+    const u32 max_fact_depth = 16;
+
+    // Times a phi's range may grow before it jumps to the next threshold
+    const u32 widen_after = 2;
+
+    inline Range full_range()     { return {INT32_MIN, INT32_MAX}; }
+    inline Range empty_range()    { return {1, 0}; }
+    inline Range point_range(i64 v) { return {v, v}; }
+
+    inline bool is_empty(Range r) { return r.lo > r.hi; }
+
+    // Only i32s (and u32s) have ranges, see Range
+    inline bool has_range(Function *f, Value_Id n) {
+        auto type = f->value(n)->value_type;
+        return type && type->type == AST::Type::INTEGER && type_bits(type) == 32;
+    }
+
+    inline bool same_range(Range a, Range b) {
+        return (is_empty(a) && is_empty(b)) || (a.lo == b.lo && a.hi == b.hi);
+    }
+
+    internal Range join(Range a, Range b) {
+        if (is_empty(a)) return b;
+        if (is_empty(b)) return a;
+        return {std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+    }
+
+    internal Range meet(Range a, Range b) {
+        return {std::max(a.lo, b.lo), std::min(a.hi, b.hi)};
+    }
+
+    // Exact bounds of + - * over the two ranges, in 64 bits where they
+    // can't overflow. Both ranges non-empty.
+    internal bool exact_bounds(u32 op, Range a, Range b, i64 *lo, i64 *hi) {
+        switch (op) {
+            case '+': *lo = a.lo + b.lo; *hi = a.hi + b.hi; return true;
+            case '-': *lo = a.lo - b.hi; *hi = a.hi - b.lo; return true;
+
+            case '*': {
+                i64 p[4] = {a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi};
+                *lo = *std::min_element(p, p + 4);
+                *hi = *std::max_element(p, p + 4);
+            } return true;
+
+            default: return false;
+        }
+    }
+
+    // Bounds of the other operators, where they're easy to get: mostly
+    // when the right side is a constant. Both ranges non-empty.
+    internal Range other_binary_range(u32 op, Range a, Range b) {
+        bool constant = b.lo == b.hi;
+        i64 c = b.lo;
+
+        // the largest remainder, division by zero can do what it likes
+        i64 largest_divisor = std::max(std::abs(b.lo), std::abs(b.hi));
+
+        switch (op) {
+            case '/':
+                if (constant && c > 0)  return {a.lo / c, a.hi / c};
+                if (constant && c < -1) return {a.hi / c, a.lo / c};
+                return full_range();
+
+            case '%':
+                if (largest_divisor == 0) return full_range();
+                if (a.lo >= 0) return {0, std::min(a.hi, largest_divisor - 1)};
+                if (a.hi <= 0) return {std::max(a.lo, 1 - largest_divisor), 0};
+                return {1 - largest_divisor, largest_divisor - 1};
+
+            // as unsigned, what looks negative here is past INT32_MAX
+            case Binary_Expression::UNSIGNED_DIV:
+                if (b.lo <= 0) return full_range();
+                if (a.lo >= 0) return {a.lo / b.hi, a.hi / b.lo};
+                if (b.lo >= 2) return {0, (i64)UINT32_MAX / b.lo};
+                return full_range();
+
+            case Binary_Expression::UNSIGNED_MOD:
+                if (b.lo <= 0) return full_range();
+                if (a.lo >= 0) return {0, std::min(a.hi, b.hi - 1)};
+                return {0, b.hi - 1};
+
+            case '&':
+                if (a.lo >= 0 && b.lo >= 0) return {0, std::min(a.hi, b.hi)};
+                if (a.lo >= 0) return {0, a.hi};
+                if (b.lo >= 0) return {0, b.hi};
+                return full_range();
+        }
+
+        if (!constant || c < 0 || c > 31) return full_range();
+
+        switch (op) {
+            case Binary_Expression::SHIFT_LEFT: {
+                i64 lo = a.lo * ((i64)1 << c), hi = a.hi * ((i64)1 << c);
+                if (lo < INT32_MIN || hi > INT32_MAX) return full_range();
+                return {lo, hi};
+            }
+
+            case Binary_Expression::SHIFT_RIGHT:
+                return {a.lo >> c, a.hi >> c};
+
+            case Binary_Expression::UNSIGNED_SHIFT_RIGHT:
+                if (a.lo >= 0) return {a.lo >> c, a.hi >> c};
+                if (c > 0)     return {0, (i64)UINT32_MAX >> c};
+                return full_range();
+
+            default: return full_range();
+        }
+    }
+
+    internal Range binary_range(u32 op, Range a, Range b) {
+        if (is_empty(a) || is_empty(b)) return empty_range();
+
+        // as unsigned, what looks negative here is past INT32_MAX, so the
+        // order is the same when both sides have the same sign
+        bool same_sign = (a.lo >= 0 && b.lo >= 0) || (a.hi < 0 && b.hi < 0);
+
+        if (op == '<' || (op == Binary_Expression::UNSIGNED_LESS && same_sign)) {
+            if (a.hi <  b.lo) return point_range(1);
+            if (a.lo >= b.hi) return point_range(0);
+            return {0, 1};
+        }
+
+        if (op == Binary_Expression::UNSIGNED_LESS) return {0, 1};
+
+        i64 lo, hi;
+        if (!exact_bounds(op, a, b, &lo, &hi)) return other_binary_range(op, a, b);
+
+        // i32 arithmetic wraps, and then the result could be anything
+        if (lo < INT32_MIN || hi > INT32_MAX) return full_range();
+        return {lo, hi};
+    }
+
+    internal Range unary_range(u32 op, Range a) {
+        if (is_empty(a)) return a;
+
+        if (op == '-') {
+            if (a.lo == INT32_MIN) return full_range(); // -INT32_MIN wraps to itself
+            return {-a.hi, -a.lo};
+        }
+
+        return a;
+    }
+
+    // What the branch on condition going one way says about n
+    internal Range refine(Function *f, Value_Ranges *ranges, Value_Id condition, bool taken, Value_Id n, Range r) {
+        if (condition == n) {
+            if (!taken) return meet(r, point_range(0));
+
+            if (r.lo == 0) r.lo = 1;
+            else if (r.hi == 0) r.hi = -1;
+            return r;
+        }
+
+        auto bi = f->value(condition)->as<Binary_Expression>();
+        if (!bi || bi->op != '<' || !has_range(f, bi->lhs)) return r;
+        if (bi->lhs == n && bi->rhs == n) return taken ? empty_range() : r;
+
+        if (bi->lhs == n) {
+            Range other = ranges->of_value[bi->rhs];
+            if (is_empty(other)) return r;
+
+            if (taken) r.hi = std::min(r.hi, other.hi - 1); // n < other
+            else       r.lo = std::max(r.lo, other.lo);     // n >= other
+        } else if (bi->rhs == n) {
+            Range other = ranges->of_value[bi->lhs];
+            if (is_empty(other)) return r;
+
+            if (taken) r.lo = std::max(r.lo, other.lo + 1); // other < n
+            else       r.hi = std::min(r.hi, other.hi);     // other >= n
+        }
+
+        return r;
+    }
+
+    // The range of n in bb, narrowed by the branches on the way there.
+    // Only reads what's already in ranges, so get_ranges uses it too, and
+    // so do passes that keep the ranges of the IL from before they change it.
+    internal Range refined_range(Function *f, Value_Ranges *ranges, Dominator_Tree *d, Value_Id n, u32 bb) {
+        Range r = ranges->of_value[n];
+
+        u32 b = ranges->nearest_fact[bb];
+        for (u32 depth = 0; b != no_block && depth < max_fact_depth; depth++) {
+            auto fact = ranges->fact[b];
+            r = refine(f, ranges, fact.condition, fact.taken, n, r);
+
+            b = ranges->nearest_fact[d->idom[b]]; // a block with a fact isn't the entry
+        }
+
+        return r;
+    }
+
+    // n coming into bb from pred, which may branch on it
+    internal Range edge_range(Function *f, Value_Ranges *ranges, Dominator_Tree *d, Value_Id n, u32 pred, u32 bb) {
+        Range r = refined_range(f, ranges, d, n, pred);
+
+        auto term = terminator(f, pred);
+        if (term && term->type == Value::BRANCH && term->branch.true_target != term->branch.false_target) {
+            r = refine(f, ranges, term->branch.condition, term->branch.true_target == bb, n, r);
+        }
+
+        return r;
+    }
+
+    /* @note
+     * Intervals for every value, iterated over the reverse postorder until
+     * nothing changes. Phis join what comes in on each edge, narrowed by the
+     * branch that edge leaves from, and the operands of everything else are
+     * narrowed by the branches that dominate it (x < 256 holds in the block
+     * the true side goes to). A phi that keeps growing, like a loop counter,
+     * is widened to the next constant of the function (or to the end of
+     * i32) so the loop ends, then two rounds of plain recomputation take
+     * back what the widening overshot. Wrapping arithmetic gives the full
+     * range. Unreachable blocks stay empty.
+     */
+    internal Value_Ranges *get_ranges(Function *f) {
+        auto ranges = &f->analyses.ranges;
+        if (f->analyses.valid & Analyses::RANGES) return ranges;
+
+        auto cfg = get_cfg(f);
+        auto d   = get_dominators(f);
+
+        u32 block_count = f->blocks.size();
+        u32 value_count = f->value_count();
+
+        ranges->of_value.assign(value_count, empty_range());
+        ranges->fact.assign(block_count, {no_value, false});
+        ranges->nearest_fact.assign(block_count, no_block);
+
+        for (auto bb : d->reverse_postorder) {
+            u32 pred = no_block, reachable_preds = 0;
+            for (auto p : cfg->predecessors[bb]) {
+                if (is_reachable(d, p)) { pred = p; reachable_preds++; }
+            }
+
+            if (reachable_preds == 1) {
+                auto term = terminator(f, pred);
+                if (term && term->type == Value::BRANCH && term->branch.true_target != term->branch.false_target) {
+                    ranges->fact[bb] = {term->branch.condition, term->branch.true_target == bb};
+                }
+            }
+
+            if (ranges->fact[bb].condition != no_value) ranges->nearest_fact[bb] = bb;
+            else if (bb != 0)                           ranges->nearest_fact[bb] = ranges->nearest_fact[d->idom[bb]];
+        }
+
+        // where widening stops on the way to the end of i32, the constants
+        // of the function and their neighbours (to both sides of a compare)
+        Array<i64> thresholds;
+        for (auto &bb : f->blocks) {
+            for (auto n : bb.instructions) {
+                auto c = f->value(n)->as<Constant>();
+                if (c && has_range(f, n)) {
+                    i64 v = (i32)(u32)c->value;
+                    thresholds.push_back(v - 1);
+                    thresholds.push_back(v);
+                    thresholds.push_back(v + 1);
+                }
+            }
+        }
+        std::sort(thresholds.begin(), thresholds.end());
+        thresholds.erase(std::unique(thresholds.begin(), thresholds.end()), thresholds.end());
+
+        auto widen = [&](Range old, Range r) {
+            if (r.lo < old.lo) {
+                auto it = std::upper_bound(thresholds.begin(), thresholds.end(), r.lo);
+                r.lo = (it == thresholds.begin()) ? INT32_MIN : std::max(*(it - 1), (i64)INT32_MIN);
+            }
+            if (r.hi > old.hi) {
+                auto it = std::lower_bound(thresholds.begin(), thresholds.end(), r.hi);
+                r.hi = (it == thresholds.end()) ? INT32_MAX : std::min(*it, (i64)INT32_MAX);
+            }
+            return r;
+        };
+
+        auto evaluate = [&](Value_Id n, u32 bb, Range *r) {
+            auto v = f->value(n);
+
+            // whatever values of other widths are, they're not tracked
+            if (v->value_type && !has_range(f, n)) {
+                *r = full_range();
+                return true;
+            }
+
+            switch (v->type) {
+                case Value::CONSTANT: *r = point_range((i32)(u32)v->constant.value); return true;
+
+                case Value::BINARY_EXPRESSION:
+                    if (!has_range(f, v->binary.lhs)) { // a compare of other widths
+                        *r = {0, 1};
+                        return true;
+                    }
+
+                    *r = binary_range(v->binary.op, refined_range(f, ranges, d, v->binary.lhs, bb),
+                                                    refined_range(f, ranges, d, v->binary.rhs, bb));
+                    return true;
+
+                case Value::UNARY_EXPRESSION: {
+                    // i8s and i16s aren't tracked, but what they extend to is no bigger than them
+                    i64 half = (i64)1 << (type_bits(f->value(v->unary.operand)->value_type) - 1);
+
+                    switch (v->unary.op) {
+                        case Unary_Expression::SIGN_EXTEND: *r = {-half, half - 1}; return true;
+                        case Unary_Expression::ZERO_EXTEND: *r = {0, 2 * half - 1}; return true;
+                        case Unary_Expression::TRUNCATE:    *r = full_range();      return true;
+                    }
+
+                    *r = unary_range(v->unary.op, refined_range(f, ranges, d, v->unary.operand, bb));
+                } return true;
+
+                case Value::PHI: {
+                    *r = empty_range();
+                    for (u32 i = 0; i < v->phi.incoming_count; i++) {
+                        auto incoming = f->phi_incoming[v->phi.first_incoming + i];
+                        if (!is_reachable(d, incoming.block)) continue;
+
+                        *r = join(*r, edge_range(f, ranges, d, incoming.value, incoming.block, bb));
+                    }
+                } return true;
+
+                // anything, as far as we know
+                case Value::LOAD:
+                case Value::FUNCTION_CALL:
+                case Value::ARGUMENT:
+                case Value::UNDEF:
+                case Value::ALLOCA:
+                    *r = full_range();
+                    return true;
+
+                default: return false; // no value
+            }
+        };
+
+        Array<u8> updates(value_count, 0);
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+
+            for (auto bb : d->reverse_postorder) {
+                for (auto n : f->blocks[bb].instructions) {
+                    Range r;
+                    if (!evaluate(n, bb, &r)) continue;
+
+                    Range old = ranges->of_value[n];
+                    r = join(old, r);
+                    if (same_range(r, old)) continue;
+
+                    if (f->value(n)->type == Value::PHI && !is_empty(old) && updates[n]++ >= widen_after) {
+                        r = widen(old, r);
+                    }
+
+                    ranges->of_value[n] = r;
+                    changed = true;
+                }
+            }
+        }
+
+        for (u32 round = 0; round < 2; round++) {
+            for (auto bb : d->reverse_postorder) {
+                for (auto n : f->blocks[bb].instructions) {
+                    Range r;
+                    if (evaluate(n, bb, &r)) ranges->of_value[n] = meet(ranges->of_value[n], r);
+                }
+            }
+        }
+
+        f->analyses.valid |= Analyses::RANGES;
+        return ranges;
+    }
+
+    /* @note
+     * Puts get_ranges to use: anything without side effects whose range is
+     * a single value becomes that constant (comparisons that always go the
+     * same way, mostly, and eliminate_dead_code then folds their branches),
+     * and + - * that can't overflow are marked for LLVM's nsw and nuw.
+     */
+    internal bool propagate_ranges(Function *f) {
+        if (f->blocks.empty()) return false;
+
+        auto &stats = f->range_propagation;
+        u32 changes_before = stats.compares_folded + stats.values_folded + stats.no_wrap;
+
+        auto ranges = get_ranges(f);
+        auto d = get_dominators(f);
+
+        Array<Value_Id> replacement(f->value_count(), no_value);
+
+        // constants to reuse, all in the entry block after number_values
+        Value_Table constants;
+        constants.init(f->value_count());
+
+        for (auto n : f->blocks[0].instructions) {
+            auto c = f->value(n)->as<Constant>();
+            if (!c) continue;
+
+            u32 slot;
+            u64 value = c->value;
+            auto type = f->value(n)->value_type;
+            if (constants.find(hash_constant(value), [&](Value_Id other) {
+                    return f->value(other)->constant.value == value && f->value(other)->value_type == type;
+                }, &slot) == no_value) {
+                constants.insert(slot, hash_constant(value), n);
+            }
+        }
+
+        Array<Value_Id> new_constants;
+
+        auto get_constant = [&](i64 signed_value, AST::Type *type) {
+            u64 value = (u32)(i32)signed_value; // the bits of an i32, like fold_binary keeps them
+            u32 hash = hash_constant(value);
+            u32 slot;
+
+            Value_Id n = constants.find(hash, [&](Value_Id other) {
+                return f->value(other)->constant.value == value && f->value(other)->value_type == type;
+            }, &slot);
+
+            if (n == no_value) {
+                Value v;
+                v.type = Value::CONSTANT;
+                v.value_type = type;
+                v.constant.value = value;
+
+                n = f->values.size();
+                f->values.push_back(v);
+
+                constants.insert(slot, hash, n);
+                new_constants.push_back(n);
+            }
+
+            return n;
+        };
+
+        // decide everything first, the ranges are of the IL as it is
+        struct Fold { Value_Id n; i64 value; };
+        Array<Fold> folds;
+
+        for (auto bb : d->reverse_postorder) {
+            for (auto n : f->blocks[bb].instructions) {
+                auto v = f->value(n);
+                if (v->type != Value::BINARY_EXPRESSION && v->type != Value::UNARY_EXPRESSION &&
+                    v->type != Value::PHI) continue;
+                if (!has_range(f, n)) continue;
+
+                Range r = ranges->of_value[n];
+                if (!is_empty(r) && r.lo == r.hi) {
+                    folds.push_back({n, r.lo});
+
+                    if (v->type == Value::BINARY_EXPRESSION && is_compare(v->binary.op)) stats.compares_folded++;
+                    else                                                                  stats.values_folded++;
+                    continue;
+                }
+
+                auto bi = v->as<Binary_Expression>();
+                if (!bi || !has_range(f, bi->lhs)) continue;
+
+                Range a = refined_range(f, ranges, d, bi->lhs, bb);
+                Range b = refined_range(f, ranges, d, bi->rhs, bb);
+                if (is_empty(a) || is_empty(b)) continue;
+
+                i64 lo, hi;
+                if (!exact_bounds(bi->op, a, b, &lo, &hi)) continue;
+
+                u32 flags = 0;
+                if (lo >= INT32_MIN && hi <= INT32_MAX) flags |= Binary_Expression::NO_SIGNED_WRAP;
+                if (a.lo >= 0 && b.lo >= 0 && lo >= 0 && hi <= UINT32_MAX) flags |= Binary_Expression::NO_UNSIGNED_WRAP;
+
+                if ((bi->flags | flags) != bi->flags) {
+                    bi->flags |= flags;
+                    stats.no_wrap++;
+                }
+            }
+        }
+
+        if (folds.empty()) return stats.no_wrap + stats.compares_folded + stats.values_folded != changes_before;
+
+        for (auto fold : folds) {
+            Value_Id constant = get_constant(fold.value, f->value(fold.n)->value_type);
+            replacement.resize(f->value_count(), no_value);
+            replacement[fold.n] = constant;
+        }
+
+        for (auto &bb : f->blocks) {
+            auto &instructions = bb.instructions;
+
+            instructions.erase(std::remove_if(instructions.begin(), instructions.end(),
+                                              [&](Value_Id n) { return replacement[n] != no_value; }),
+                               instructions.end());
+
+            for (auto n : instructions) {
+                f->for_each_operand(f->value(n), [&](Value_Id &operand) {
+                    if (replacement[operand] != no_value) operand = replacement[operand];
+                });
+            }
+        }
+
+        auto &entry = f->blocks[0].instructions;
+        entry.insert(entry.begin(), new_constants.begin(), new_constants.end());
+
+        invalidate_analyses(f, Analyses::CFG_EDGES | Analyses::DOMINATORS | Analyses::LOOPS);
+
+        return true;
+    }
+
+};
+
+internal void print_range_stats(IL::Module *module) {
+    for (auto function : module->functions) {
+        auto &stats = function->range_propagation;
+        String name = atom_table.name(function->ast->name);
+
+        if (!stats.compares_folded && !stats.values_folded && !stats.no_wrap) continue;
+
+        fprintf(stderr, "vrp: %-24.*s %u compares folded, %u values folded, %u no-wrap\n",
+                (int)name.length, name.data,
+                stats.compares_folded, stats.values_folded, stats.no_wrap);
+    }
+}
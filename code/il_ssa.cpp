@@ -0,0 +1,260 @@
+
+namespace IL {
+
+    /* @note
+     * mem2reg: every alloca that is only ever loaded from and stored to
+     * directly (its address never escapes into a call, a store, arithmetic
+     * or an offset) is turned into SSA values. Phis go on the iterated
+     * dominance frontier of the blocks that store to it, then a walk over
+     * the dominator tree renames loads to the value reaching them, as in
+     * Cytron et al. The allocas, their loads and their stores are dropped
+     * from the blocks; their slots in Function::values just go unused.
+     */
+    internal bool promote_allocas(Function *f) {
+        if (f->blocks.empty()) return false;
+
+        u32 value_count = f->value_count();
+        u32 block_count = f->blocks.size();
+
+        // variable index of each alloca
+        Array<u32> var_of(value_count, no_value);
+        Array<Value_Id> vars;
+
+        for (auto &bb : f->blocks) {
+            for (auto n : bb.instructions) {
+                if (f->value(n)->type == Value::ALLOCA) {
+                    var_of[n] = vars.size();
+                    vars.push_back(n);
+                }
+            }
+        }
+
+        if (vars.empty()) return false;
+
+        Array<u8> promotable(vars.size(), 1);
+
+        auto escapes = [&](Value_Id n) {
+            if (var_of[n] != no_value) promotable[var_of[n]] = 0;
+        };
+
+        for (auto &bb : f->blocks) {
+            for (auto n : bb.instructions) {
+                auto v = f->value(n);
+
+                if (v->type == Value::LOAD && v->load.offset == no_value) {
+                    continue;
+                } else if (v->type == Value::STORE && v->store.offset == no_value) {
+                    escapes(v->store.source);
+                } else {
+                    f->for_each_operand(v, escapes);
+                }
+            }
+        }
+
+        if (std::find(promotable.begin(), promotable.end(), 1) == promotable.end()) return false;
+
+        auto promoted = [&](Value_Id base) {
+            return var_of[base] != no_value && promotable[var_of[base]];
+        };
+
+        auto cfg = get_cfg(f);
+        auto d   = get_dominators(f);
+
+        // the blocks storing to each variable, each block once
+        Array<Array<u32>> def_blocks(vars.size());
+
+        for (u32 bb = 0; bb < block_count; bb++) {
+            if (!is_reachable(d, bb)) continue;
+
+            for (auto n : f->blocks[bb].instructions) {
+                auto v = f->value(n);
+                if (v->type != Value::STORE || !promoted(v->store.base)) continue;
+
+                auto &defs = def_blocks[var_of[v->store.base]];
+                if (defs.empty() || defs.back() != bb) defs.push_back(bb);
+            }
+        }
+
+        // place phis
+        Array<Array<Value_Id>> block_phis(block_count);
+        Array<u32> phi_var;          // by phi, in order of creation
+        Array<Value_Id> phis;
+        Array<u32> has_phi(block_count, no_value), queued(block_count, no_value);
+        Array<u32> worklist;
+
+        for (u32 var = 0; var < vars.size(); var++) {
+            if (!promotable[var]) continue;
+
+            worklist = def_blocks[var];
+            for (auto bb : worklist) queued[bb] = var;
+
+            while (worklist.size()) {
+                u32 bb = worklist.back();
+                worklist.pop_back();
+
+                for (auto join : d->frontier[bb]) {
+                    if (has_phi[join] == var) continue;
+                    has_phi[join] = var;
+
+                    Value phi;
+                    phi.type = Value::PHI;
+                    phi.value_type = f->value(vars[var])->value_type;
+                    phi.phi.first_incoming = f->phi_incoming.size();
+                    phi.phi.incoming_count = cfg->predecessors[join].size();
+
+                    for (auto p : cfg->predecessors[join]) {
+                        f->phi_incoming.push_back({no_value, p});
+                    }
+
+                    Value_Id n = f->values.size();
+                    f->values.push_back(phi);
+                    block_phis[join].push_back(n);
+                    phis.push_back(n);
+                    phi_var.push_back(var);
+
+                    // a phi is a store too
+                    if (queued[join] != var) {
+                        queued[join] = var;
+                        worklist.push_back(join);
+                    }
+                }
+            }
+        }
+
+        // reads with no store before them see undef, one of each type
+        Array<Value_Id> undefs;
+        auto get_undef = [&](u32 var) {
+            auto type = f->value(vars[var])->value_type;
+            for (auto n : undefs) {
+                if (f->value(n)->value_type == type) return n;
+            }
+
+            Value v;
+            v.type = Value::UNDEF;
+            v.value_type = type;
+            undefs.push_back(f->values.size());
+            f->values.push_back(v);
+            return undefs.back();
+        };
+
+        Array<Value_Id> replacement(f->value_count(), no_value);
+        Array<u8> dead(f->value_count(), 0);
+
+        auto resolve = [&](Value_Id n) {
+            return (n != no_value && replacement[n] != no_value) ? replacement[n] : n;
+        };
+
+        Array<u32> var_of_phi(f->value_count(), no_value);
+        for (u32 i = 0; i < phis.size(); i++) var_of_phi[phis[i]] = phi_var[i];
+
+        // rename, walking the dominator tree with an explicit stack
+        Array<Array<Value_Id>> current(vars.size());
+        Array<u32> pushed; // vars pushed on current, to undo on the way out
+
+        auto current_value = [&](u32 var) {
+            return current[var].empty() ? get_undef(var) : current[var].back();
+        };
+
+        auto fill_successor_phis = [&](u32 bb, bool reachable) {
+            for (auto s : cfg->successors[bb]) {
+                for (auto phi_n : block_phis[s]) {
+                    auto &phi = f->value(phi_n)->phi;
+
+                    for (u32 i = 0; i < phi.incoming_count; i++) {
+                        auto &incoming = f->phi_incoming[phi.first_incoming + i];
+                        if (incoming.block != bb) continue;
+
+                        incoming.value = reachable ? current_value(var_of_phi[phi_n]) : get_undef(var_of_phi[phi_n]);
+                    }
+                }
+            }
+        };
+
+        auto rewrite_block = [&](u32 bb, bool reachable) {
+            for (auto phi_n : block_phis[bb]) {
+                current[var_of_phi[phi_n]].push_back(phi_n);
+                pushed.push_back(var_of_phi[phi_n]);
+            }
+
+            for (auto n : f->blocks[bb].instructions) {
+                auto v = f->value(n);
+
+                if (v->type == Value::LOAD && v->load.offset == no_value && promoted(v->load.base)) {
+                    u32 var = var_of[v->load.base];
+                    replacement[n] = reachable ? current_value(var) : get_undef(var);
+                    dead[n] = 1;
+                } else if (v->type == Value::STORE && v->store.offset == no_value && promoted(v->store.base)) {
+                    u32 var = var_of[v->store.base];
+                    current[var].push_back(resolve(v->store.source));
+                    pushed.push_back(var);
+                    dead[n] = 1;
+                } else if (v->type == Value::ALLOCA && promoted(n)) {
+                    dead[n] = 1;
+                }
+            }
+
+            fill_successor_phis(bb, reachable);
+        };
+
+        struct Walk { u32 bb; u32 pushed_before; bool leaving; };
+        Array<Walk> walk;
+        walk.push_back({0, 0, false});
+
+        while (walk.size()) {
+            auto item = walk.back();
+            walk.pop_back();
+
+            if (item.leaving) {
+                while (pushed.size() > item.pushed_before) {
+                    current[pushed.back()].pop_back();
+                    pushed.pop_back();
+                }
+                continue;
+            }
+
+            walk.push_back({item.bb, (u32)pushed.size(), true});
+            rewrite_block(item.bb, true);
+
+            for (auto child : d->children[item.bb]) {
+                walk.push_back({child, 0, false});
+            }
+        }
+
+        // nothing reaches these, but they still have to make sense
+        for (u32 bb = 0; bb < block_count; bb++) {
+            if (!is_reachable(d, bb)) {
+                rewrite_block(bb, false);
+                pushed.clear();
+                for (auto &stack : current) stack.clear();
+            }
+        }
+
+        replacement.resize(f->value_count(), no_value);
+
+        // drop what was promoted, rewrite uses of the loads, phis go first
+        for (u32 bb = 0; bb < block_count; bb++) {
+            auto &instructions = f->blocks[bb].instructions;
+
+            Array<Value_Id> kept = block_phis[bb];
+            if (bb == 0) kept.insert(kept.begin(), undefs.begin(), undefs.end());
+
+            for (auto n : instructions) {
+                if (!dead[n]) kept.push_back(n);
+            }
+
+            for (auto n : kept) {
+                f->for_each_operand(f->value(n), [&](Value_Id &operand) {
+                    operand = resolve(operand);
+                });
+            }
+
+            instructions.swap(kept);
+        }
+
+        // phis and undef went in, but the blocks and their edges are the same
+        invalidate_analyses(f, Analyses::CFG_EDGES | Analyses::DOMINATORS | Analyses::LOOPS);
+
+        return true;
+    }
+
+};
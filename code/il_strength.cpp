@@ -0,0 +1,687 @@
+
+namespace IL {
+
+    // x / d for d > 0 is mulhs(x, multiplier), plus x if the multiplier
+    // came out negative, shifted right by shift, plus one if x is negative.
+    // Hacker's Delight, 10-4.
+    struct Signed_Magic {
+        i32 multiplier;
+        u32 shift;
+    };
+
+    // for 2 < d < 2^31, not a power of two
+    internal Signed_Magic signed_magic(u32 d) {
+        const u32 two31 = 0x80000000u;
+
+        u32 anc = two31 - 1 - two31 % d; // |nc|, the largest multiple of d minus one below 2^31
+        u32 p = 31;
+        u32 q1 = two31 / anc, r1 = two31 - q1 * anc;
+        u32 q2 = two31 / d,   r2 = two31 - q2 * d;
+        u32 delta;
+
+        do {
+            p++;
+
+            q1 *= 2; r1 *= 2;
+            if (r1 >= anc) { q1++; r1 -= anc; }
+
+            q2 *= 2; r2 *= 2;
+            if (r2 >= d) { q2++; r2 -= d; }
+
+            delta = d - r2;
+        } while (q1 < delta || (q1 == delta && r1 == 0));
+
+        return {(i32)(q2 + 1), p - 32};
+    }
+
+    // x / d is mulhu(x, multiplier) >> shift. When the multiplier needs 33
+    // bits add is set, and with t = mulhu(x, multiplier) it's
+    // (((x - t) >> 1) + t) >> (shift - 1) instead. Hacker's Delight, 10-10.
+    struct Unsigned_Magic {
+        u32 multiplier;
+        bool add;
+        u32 shift;
+    };
+
+    // for d > 2, not a power of two
+    internal Unsigned_Magic unsigned_magic(u32 d) {
+        bool add = false;
+
+        u32 nc = ~0u - (0u - d) % d;
+        u32 p = 31;
+        u32 q1 = 0x80000000u / nc, r1 = 0x80000000u - q1 * nc;
+        u32 q2 = 0x7FFFFFFFu / d,  r2 = 0x7FFFFFFFu - q2 * d;
+        u32 delta;
+
+        do {
+            p++;
+
+            if (r1 >= nc - r1) { q1 = 2 * q1 + 1; r1 = 2 * r1 - nc; }
+            else               { q1 = 2 * q1;     r1 = 2 * r1; }
+
+            if (r2 + 1 >= d - r2) {
+                if (q2 >= 0x7FFFFFFFu) add = true;
+                q2 = 2 * q2 + 1; r2 = 2 * r2 + 1 - d;
+            } else {
+                if (q2 >= 0x80000000u) add = true;
+                q2 = 2 * q2;     r2 = 2 * r2 + 1;
+            }
+
+            delta = d - 1 - r2;
+        } while (p < 64 && (q1 < delta || (q1 == delta && r1 == 0)));
+
+        return {q2 + 1, add, p - 32};
+    }
+
+    inline bool is_power_of_two(u64 x) { return x && !(x & (x - 1)); }
+
+    // What a rewritten instruction turns into, after the instructions it
+    // needs. With op copy_step it's just lhs, and uses go there instead.
+    struct Step {
+        u32 op;
+        Value_Id lhs, rhs;
+    };
+
+    const u32 copy_step = ~0u;
+
+    /* @note
+     * Emits a rewrite into the block being rebuilt, in front of the
+     * instruction it replaces. Constants are reused from the entry block,
+     * where number_values leaves them all, and new ones go there too.
+     * What it makes is all of type, the type of what's being rewritten.
+     */
+    struct Rewriter {
+        Function *f;
+        Array<Value_Id> *out;
+        AST::Type *type;
+
+        Value_Table constants;
+        Array<Value_Id> new_constants;
+
+        void init(Function *function) {
+            f = function;
+            out = nullptr;
+            type = nullptr;
+
+            constants.init(f->value_count());
+            new_constants.clear();
+
+            for (auto n : f->blocks[0].instructions) {
+                auto c = f->value(n)->as<Constant>();
+                if (!c) continue;
+
+                u32 slot;
+                u64 value = c->value;
+                auto value_type = f->value(n)->value_type;
+                if (constants.find(hash_constant(value), [&](Value_Id other) {
+                        return f->value(other)->constant.value == value && f->value(other)->value_type == value_type;
+                    }, &slot) == no_value) {
+                    constants.insert(slot, hash_constant(value), n);
+                }
+            }
+        }
+
+        Value_Id constant(u64 value) {
+            value = truncate_bits(value, type_bits(type));
+
+            u32 hash = hash_constant(value);
+            u32 slot;
+
+            Value_Id n = constants.find(hash, [&](Value_Id other) {
+                return f->value(other)->constant.value == value && f->value(other)->value_type == type;
+            }, &slot);
+
+            if (n == no_value) {
+                Value v;
+                v.type = Value::CONSTANT;
+                v.value_type = type;
+                v.constant.value = value;
+
+                n = f->values.size();
+                f->values.push_back(v);
+
+                constants.insert(slot, hash, n);
+                new_constants.push_back(n);
+            }
+
+            return n;
+        }
+
+        // an instruction of no block yet
+        Value_Id make(u32 op, Value_Id lhs, Value_Id rhs) {
+            Value v;
+            v.type = Value::BINARY_EXPRESSION;
+            v.value_type = type;
+            v.binary.op    = op;
+            v.binary.lhs   = lhs;
+            v.binary.rhs   = rhs;
+            v.binary.flags = 0;
+
+            f->values.push_back(v);
+            return f->values.size() - 1;
+        }
+
+        Value_Id emit(u32 op, Value_Id lhs, Value_Id rhs) {
+            Value_Id n = make(op, lhs, rhs);
+            out->push_back(n);
+            return n;
+        }
+
+        Value_Id emit(Step step) {
+            if (step.op == copy_step) return step.lhs;
+            return emit(step.op, step.lhs, step.rhs);
+        }
+
+        void add_constants_to_entry() {
+            auto &entry = f->blocks[0].instructions;
+            entry.insert(entry.begin(), new_constants.begin(), new_constants.end());
+            new_constants.clear();
+        }
+    };
+
+    internal Step shift_step(Rewriter *w, u32 op, Value_Id x, u32 shift) {
+        if (shift == 0) return {copy_step, x, no_value};
+        return {op, x, w->constant(shift)};
+    }
+
+    // at any width, c is cut to it
+    internal bool lower_multiply(Rewriter *w, Value_Id x, u64 c, Step *step) {
+        u32 bits = type_bits(w->type);
+        u64 negated = truncate_bits(0 - c, bits);
+
+        if (c == 0) { *step = {copy_step, w->constant(0), no_value}; return true; }
+        if (c == 1) { *step = {copy_step, x, no_value}; return true; }
+
+        if (is_power_of_two(c)) {
+            *step = {Binary_Expression::SHIFT_LEFT, x, w->constant(__builtin_ctzll(c))};
+            return true;
+        }
+
+        if (is_power_of_two(negated)) {
+            Step shifted = shift_step(w, Binary_Expression::SHIFT_LEFT, x, __builtin_ctzll(negated));
+            *step = {'-', w->constant(0), w->emit(shifted)};
+            return true;
+        }
+
+        return false;
+    }
+
+    internal bool lower_unsigned_div(Rewriter *w, Value_Id x, u32 d, Step *step) {
+        if (d == 0) return false;
+
+        if (is_power_of_two(d)) {
+            *step = shift_step(w, Binary_Expression::UNSIGNED_SHIFT_RIGHT, x, __builtin_ctz(d));
+            return true;
+        }
+
+        auto magic = unsigned_magic(d);
+        Value_Id t = w->emit(Binary_Expression::UNSIGNED_MULTIPLY_HIGH, x, w->constant(magic.multiplier));
+
+        if (!magic.add) {
+            *step = shift_step(w, Binary_Expression::UNSIGNED_SHIFT_RIGHT, t, magic.shift);
+            return true;
+        }
+
+        Value_Id u = w->emit('-', x, t);
+        u = w->emit(Binary_Expression::UNSIGNED_SHIFT_RIGHT, u, w->constant(1));
+        u = w->emit('+', u, t);
+
+        *step = shift_step(w, Binary_Expression::UNSIGNED_SHIFT_RIGHT, u, magic.shift - 1);
+        return true;
+    }
+
+    internal bool lower_unsigned_mod(Rewriter *w, Value_Id x, u32 d, Step *step) {
+        if (d == 0) return false;
+
+        if (is_power_of_two(d)) {
+            *step = (d == 1) ? Step{copy_step, w->constant(0), no_value}
+                             : Step{'&', x, w->constant(d - 1)};
+            return true;
+        }
+
+        Step quotient;
+        if (!lower_unsigned_div(w, x, d, &quotient)) return false;
+
+        Value_Id product = w->emit('*', w->emit(quotient), w->constant(d));
+        *step = {'-', x, product};
+        return true;
+    }
+
+    // Division truncates, so a negative x needs |d| - 1 added before it's
+    // shifted: the top bits of its sign, shifted down
+    internal Value_Id round_towards_zero(Rewriter *w, Value_Id x, u32 shift) {
+        Value_Id sign = (shift > 1) ? w->emit(Binary_Expression::SHIFT_RIGHT, x, w->constant(shift - 1)) : x;
+        Value_Id bias = w->emit(Binary_Expression::UNSIGNED_SHIFT_RIGHT, sign, w->constant(32 - shift));
+        return w->emit('+', x, bias);
+    }
+
+    internal bool lower_signed_div(Rewriter *w, Value_Id x, i32 d, bool x_nonnegative, Step *step) {
+        if (d == 0 || d == INT32_MIN) return false;
+
+        if (d == 1)  { *step = {copy_step, x, no_value}; return true; }
+        if (d == -1) { *step = {'-', w->constant(0), x}; return true; }
+
+        u32 ad = (d < 0) ? 0u - (u32)d : (u32)d;
+        Step quotient;
+
+        if (is_power_of_two(ad)) {
+            u32 shift = __builtin_ctz(ad);
+            Value_Id rounded = x_nonnegative ? x : round_towards_zero(w, x, shift);
+
+            quotient = {Binary_Expression::SHIFT_RIGHT, rounded, w->constant(shift)};
+        } else {
+            auto magic = signed_magic(ad);
+
+            Value_Id q = w->emit(Binary_Expression::MULTIPLY_HIGH, x, w->constant((u32)magic.multiplier));
+            if (magic.multiplier < 0) q = w->emit('+', q, x);
+
+            quotient = shift_step(w, Binary_Expression::SHIFT_RIGHT, q, magic.shift);
+
+            // one more for negative x, which rounded down
+            if (!x_nonnegative) {
+                q = w->emit(quotient);
+                quotient = {'+', q, w->emit(Binary_Expression::UNSIGNED_SHIFT_RIGHT, x, w->constant(31))};
+            }
+        }
+
+        if (d > 0) *step = quotient;
+        else       *step = {'-', w->constant(0), w->emit(quotient)};
+
+        return true;
+    }
+
+    // The remainder has the sign of x, and x % -d is x % d
+    internal bool lower_signed_mod(Rewriter *w, Value_Id x, i32 d, bool x_nonnegative, Step *step) {
+        if (d == 0 || d == INT32_MIN) return false;
+
+        u32 ad = (d < 0) ? 0u - (u32)d : (u32)d;
+
+        if (ad == 1) { *step = {copy_step, w->constant(0), no_value}; return true; }
+
+        if (is_power_of_two(ad)) {
+            if (x_nonnegative) {
+                *step = {'&', x, w->constant(ad - 1)};
+            } else {
+                Value_Id rounded = round_towards_zero(w, x, __builtin_ctz(ad));
+                *step = {'-', x, w->emit('&', rounded, w->constant(0u - ad))};
+            }
+            return true;
+        }
+
+        Step quotient;
+        lower_signed_div(w, x, (i32)ad, x_nonnegative, &quotient);
+
+        Value_Id product = w->emit('*', w->emit(quotient), w->constant(ad));
+        *step = {'-', x, product};
+        return true;
+    }
+
+    /* @note
+     * A loop counter i that goes up by a constant step each iteration (a
+     * header phi of its start and i + step from the latch) makes i * c a
+     * counter of its own, starting at start * c and going up by step * c.
+     * It's a phi and an add where the multiply was, and they agree even
+     * when they wrap. Inner loops go first, so the start * c an inner loop
+     * gets in its preheader can be a counter of the outer loop in turn.
+     */
+    internal u32 reduce_induction_variables(Function *f, Rewriter *w) {
+        auto cfg  = get_cfg(f);
+        auto nest = get_loops(f);
+
+        Array<u32> block_of(f->value_count(), no_block);
+        for (u32 bb = 0; bb < f->blocks.size(); bb++) {
+            for (auto n : f->blocks[bb].instructions) block_of[n] = bb;
+        }
+
+        Array<Value_Id> replacement(f->value_count(), no_value);
+
+        auto constant_of = [&](Value_Id n, u64 *value) {
+            auto c = f->value(n)->as<Constant>();
+            if (c) *value = c->value;
+            return c != nullptr;
+        };
+
+        struct Counter { Value_Id phi, start, next; u64 step; };
+        struct Reduced { Value_Id counter; u64 factor; Value_Id phi; };
+        struct Increment { Value_Id after, n; };
+
+        Array<Counter> counters;
+        Array<Reduced> reduced;
+        Array<Increment> increments;
+        Array<Value_Id> new_phis, preheader_values;
+
+        u32 reduced_count = 0;
+
+        for (u32 i = nest->loops.size(); i-- > 0;) {
+            auto loop = &nest->loops[i];
+            if (loop->latches.size() != 1) continue;
+
+            u32 latch = loop->latches[0];
+
+            u32 preheader = no_block;
+            bool single = true;
+            for (auto p : cfg->predecessors[loop->header]) {
+                if (p == latch) continue;
+                if (preheader != no_block) single = false;
+                preheader = p;
+            }
+            if (!single || preheader == no_block || !terminator(f, preheader)) continue;
+
+            counters.clear();
+
+            for (auto n : f->blocks[loop->header].instructions) {
+                auto phi = f->value(n)->as<Phi>();
+                if (!phi) break; // phis come first
+                if (phi->incoming_count != 2) continue;
+
+                Value_Id start = no_value, next = no_value;
+                for (u32 k = 0; k < 2; k++) {
+                    auto incoming = f->phi_incoming[phi->first_incoming + k];
+                    if (incoming.block == preheader) start = incoming.value;
+                    else if (incoming.block == latch) next = incoming.value;
+                }
+                if (start == no_value || next == no_value) continue;
+
+                auto bi = f->value(next)->as<Binary_Expression>();
+                if (!bi) continue;
+
+                u64 step;
+                if      (bi->op == '+' && bi->lhs == n && constant_of(bi->rhs, &step)) {}
+                else if (bi->op == '+' && bi->rhs == n && constant_of(bi->lhs, &step)) {}
+                else if (bi->op == '-' && bi->lhs == n && constant_of(bi->rhs, &step)) step = 0 - step;
+                else continue;
+
+                counters.push_back({n, start, next, step});
+            }
+
+            if (counters.empty()) continue;
+
+            reduced.clear();
+            increments.clear();
+            new_phis.clear();
+            preheader_values.clear();
+
+            for (auto bb : loop->blocks) {
+                for (auto n : f->blocks[bb].instructions) {
+                    auto bi = f->value(n)->as<Binary_Expression>();
+                    if (!bi || bi->op != '*' || replacement[n] != no_value) continue;
+
+                    Counter *counter = nullptr;
+                    u64 factor = 0;
+
+                    for (auto &c : counters) {
+                        if ((bi->lhs == c.phi && constant_of(bi->rhs, &factor)) ||
+                            (bi->rhs == c.phi && constant_of(bi->lhs, &factor))) {
+                            counter = &c;
+                            break;
+                        }
+                    }
+                    if (!counter) continue;
+
+                    Value_Id phi_n = no_value;
+                    for (auto r : reduced) {
+                        if (r.counter == counter->phi && r.factor == factor) phi_n = r.phi;
+                    }
+
+                    if (phi_n == no_value) {
+                        u64 start_value;
+                        Value_Id start;
+
+                        w->type = f->value(n)->value_type; // the constants cut the products to it
+
+                        if (constant_of(counter->start, &start_value)) {
+                            start = w->constant(start_value * factor);
+                        } else {
+                            start = w->make('*', counter->start, w->constant(factor));
+                            preheader_values.push_back(start);
+
+                            block_of.resize(f->value_count(), no_block);
+                            block_of[start] = preheader;
+                        }
+
+                        phi_n = add_phi(f, 2, w->type);
+                        Value_Id next = w->make('+', phi_n, w->constant(counter->step * factor));
+
+                        auto phi = f->value(phi_n)->phi;
+                        f->phi_incoming[phi.first_incoming + 0] = {start, preheader};
+                        f->phi_incoming[phi.first_incoming + 1] = {next,  latch};
+
+                        // right after the counter's own increment, so it's
+                        // there whenever that is
+                        increments.push_back({counter->next, next});
+                        new_phis.push_back(phi_n);
+                        reduced.push_back({counter->phi, factor, phi_n});
+
+                        block_of.resize(f->value_count(), no_block);
+                        block_of[next]  = block_of[counter->next];
+                        block_of[phi_n] = loop->header;
+                    }
+
+                    replacement.resize(f->value_count(), no_value);
+                    replacement[n] = phi_n;
+                    reduced_count++;
+                }
+            }
+
+            if (new_phis.empty()) continue;
+
+            for (auto increment : increments) {
+                auto &instructions = f->blocks[block_of[increment.after]].instructions;
+                instructions.insert(std::find(instructions.begin(), instructions.end(), increment.after) + 1, increment.n);
+            }
+
+            auto &header = f->blocks[loop->header].instructions;
+            header.insert(header.begin(), new_phis.begin(), new_phis.end());
+
+            auto &pre_instructions = f->blocks[preheader].instructions;
+            pre_instructions.insert(pre_instructions.end() - 1, preheader_values.begin(), preheader_values.end());
+        }
+
+        if (!reduced_count) return 0;
+
+        replacement.resize(f->value_count(), no_value);
+
+        auto resolve = [&](Value_Id n) {
+            while (replacement[n] != no_value) n = replacement[n];
+            return n;
+        };
+
+        for (auto &bb : f->blocks) {
+            auto &instructions = bb.instructions;
+
+            instructions.erase(std::remove_if(instructions.begin(), instructions.end(),
+                                              [&](Value_Id n) { return replacement[n] != no_value; }),
+                               instructions.end());
+
+            for (auto n : instructions) {
+                f->for_each_operand(f->value(n), [&](Value_Id &operand) {
+                    operand = resolve(operand);
+                });
+            }
+        }
+
+        invalidate_analyses(f);
+        return reduced_count;
+    }
+
+    /* @note
+     * Multiplies by constants become shifts where they can, and / and % by
+     * constants become a multiply by a magic number, keeping the high half,
+     * and shifts (Hacker's Delight, chapter 10). That's a few cycles where a
+     * division takes tens. A signed division whose dividend get_ranges shows
+     * isn't negative skips the fixups for negative numbers. Multiplies of
+     * loop counters go first, see reduce_induction_variables.
+     *
+     * A rewritten instruction turns into the last step of its rewrite, with
+     * the instructions before it in front of it, so most uses stay as they
+     * are.
+     */
+    internal bool reduce_strength(Function *f) {
+        if (f->blocks.empty()) return false;
+
+        auto &stats = f->strength_reduction;
+        u32 changes_before = stats.multiplies + stats.divisions + stats.induction_variables;
+
+        auto constant_of = [&](Value_Id n, u64 *value) {
+            auto c = f->value(n)->as<Constant>();
+            if (c) *value = c->value;
+            return c != nullptr;
+        };
+
+        // most functions have nothing to do here, don't set anything up for them
+        bool candidates = false;
+        for (auto &bb : f->blocks) {
+            for (auto n : bb.instructions) {
+                auto bi = f->value(n)->as<Binary_Expression>();
+                if (!bi) continue;
+
+                bool divides = bi->op == '/' || bi->op == '%' ||
+                               bi->op == Binary_Expression::UNSIGNED_DIV || bi->op == Binary_Expression::UNSIGNED_MOD;
+                u64 c;
+                if ((bi->op == '*' && (constant_of(bi->lhs, &c) || constant_of(bi->rhs, &c))) ||
+                    (divides && constant_of(bi->rhs, &c))) {
+                    candidates = true;
+                }
+            }
+        }
+        if (!candidates) return false;
+
+        Rewriter w;
+        w.init(f);
+
+        stats.induction_variables += reduce_induction_variables(f, &w);
+        w.add_constants_to_entry(); // get_ranges has to see them
+
+        // the ranges have to be of the IL before it's rewritten
+        Value_Ranges *ranges = nullptr;
+        for (auto &bb : f->blocks) {
+            for (auto n : bb.instructions) {
+                auto bi = f->value(n)->as<Binary_Expression>();
+                u64 c;
+                if (bi && (bi->op == '/' || bi->op == '%') && constant_of(bi->rhs, &c)) ranges = get_ranges(f);
+            }
+        }
+
+        auto d = ranges ? get_dominators(f) : nullptr;
+
+        auto nonnegative = [&](Value_Id n, u32 bb) {
+            return refined_range(f, ranges, d, n, bb).lo >= 0;
+        };
+
+        Array<Value_Id> replacement(f->value_count(), no_value);
+        Array<Value_Id> out;
+        w.out = &out;
+
+        bool rewritten = false;
+
+        for (u32 bb = 0; bb < f->blocks.size(); bb++) {
+            out.clear();
+
+            for (auto n : f->blocks[bb].instructions) {
+                auto bi = f->value(n)->as<Binary_Expression>();
+                if (!bi) {
+                    out.push_back(n);
+                    continue;
+                }
+
+                Value_Id lhs = bi->lhs, rhs = bi->rhs;
+                u64 c;
+                Step step;
+                bool lowered = false;
+
+                // the magic numbers are for i32s, other widths only get their multiplies done
+                w.type = f->value(n)->value_type;
+                u32 op = (type_bits(w.type) == 32 || bi->op == '*') ? bi->op : 0;
+
+                switch (op) {
+                    case '*':
+                        if      (constant_of(rhs, &c)) lowered = lower_multiply(&w, lhs, c, &step);
+                        else if (constant_of(lhs, &c)) lowered = lower_multiply(&w, rhs, c, &step);
+                        if (lowered) stats.multiplies++;
+                        break;
+
+                    case '/':
+                        if (constant_of(rhs, &c)) lowered = lower_signed_div(&w, lhs, (i32)c, nonnegative(lhs, bb), &step);
+                        if (lowered) stats.divisions++;
+                        break;
+
+                    case '%':
+                        if (constant_of(rhs, &c)) lowered = lower_signed_mod(&w, lhs, (i32)c, nonnegative(lhs, bb), &step);
+                        if (lowered) stats.divisions++;
+                        break;
+
+                    case Binary_Expression::UNSIGNED_DIV:
+                        if (constant_of(rhs, &c)) lowered = lower_unsigned_div(&w, lhs, (u32)c, &step);
+                        if (lowered) stats.divisions++;
+                        break;
+
+                    case Binary_Expression::UNSIGNED_MOD:
+                        if (constant_of(rhs, &c)) lowered = lower_unsigned_mod(&w, lhs, (u32)c, &step);
+                        if (lowered) stats.divisions++;
+                        break;
+                }
+
+                if (!lowered) {
+                    out.push_back(n);
+                    continue;
+                }
+
+                rewritten = true;
+
+                if (step.op == copy_step) {
+                    replacement.resize(f->value_count(), no_value);
+                    replacement[n] = step.lhs;
+                    continue;
+                }
+
+                auto v = f->value(n);
+                v->binary.op    = step.op;
+                v->binary.lhs   = step.lhs;
+                v->binary.rhs   = step.rhs;
+                v->binary.flags = 0;
+
+                out.push_back(n);
+            }
+
+            f->blocks[bb].instructions.swap(out);
+        }
+
+        if (rewritten) {
+            replacement.resize(f->value_count(), no_value);
+
+            auto resolve = [&](Value_Id n) {
+                while (replacement[n] != no_value) n = replacement[n];
+                return n;
+            };
+
+            for (auto &bb : f->blocks) {
+                for (auto n : bb.instructions) {
+                    f->for_each_operand(f->value(n), [&](Value_Id &operand) {
+                        operand = resolve(operand);
+                    });
+                }
+            }
+        }
+
+        w.add_constants_to_entry();
+
+        // instructions changed, the blocks and edges didn't
+        invalidate_analyses(f, Analyses::CFG_EDGES | Analyses::DOMINATORS | Analyses::LOOPS);
+
+        return stats.multiplies + stats.divisions + stats.induction_variables != changes_before;
+    }
+
+};
+
+internal void print_strength_stats(IL::Module *module) {
+    for (auto function : module->functions) {
+        auto &stats = function->strength_reduction;
+        String name = atom_table.name(function->ast->name);
+
+        if (!stats.multiplies && !stats.divisions && !stats.induction_variables) continue;
+
+        fprintf(stderr, "strength: %-19.*s %u multiplies, %u divisions, %u induction variables\n",
+                (int)name.length, name.data,
+                stats.multiplies, stats.divisions, stats.induction_variables);
+    }
+}
@@ -1,4 +1,5 @@
 
+#ifdef _WIN32
 internal char *read_entire_file(const char *filename) {
     FILE *fp = fopen(filename, "rb");
 
@@ -27,27 +28,258 @@ internal char *read_entire_file(const char *filename) {
 
     return buffer;
 }
+#endif
+
+// Maps the file read-only with at least one zero byte after it, so the lexer
+// can use it as a '\0' terminated string without copying it, and tokens can
+// refer back into it. Falls back to reading the file where there's no mmap.
+internal char *map_entire_file(const char *filename) {
+#ifdef _WIN32
+    return read_entire_file(filename);
+#else
+    int fd = open(filename, O_RDONLY);
+
+    if (fd == -1) {
+        return nullptr;
+    }
 
-internal Token make_token(u32 type, u32 l, u32 c) {
-    Token t;
-    t.l = l;
-    t.c = c;
-    t.type = type;
-    return t;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return nullptr;
+    }
+
+    // Reserve zero pages for the file plus at least one byte, then map the
+    // file over the front. Bytes past the end of the file are zero either way.
+    size_t length = st.st_size;
+    size_t page   = sysconf(_SC_PAGESIZE);
+    size_t size   = (length / page + 1) * page;
+
+    void *base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (base != MAP_FAILED && length != 0) {
+        if (mmap(base, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(base, size);
+            base = MAP_FAILED;
+        }
+    }
+
+    close(fd);
+
+    return (base == MAP_FAILED) ? nullptr : (char *)base;
+#endif
 }
 
-internal bool is_space(char c) {
-    return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') || (c == '\v') || (c == '\f');
+internal Token make_token(u32 type, u32 offset) {
+    Token t;
+    t.type      = type;
+    t.offset    = offset;
+    t.int_value = 0;
+    return t;
 }
 
 internal bool starts_ident(char c) {
     return (c == '_') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
 }
 
+/* @note
+ * Scanning kernels for the lexer. They look at 32 (AVX2) or 16 (SSE2) bytes
+ * at a time and fall back to one byte at a time elsewhere.
+ * Loads are aligned down to the vector size, so they never cross into a page
+ * the source buffer doesn't touch, even when the '\0' is in the middle of a
+ * vector. Lanes before the start pointer are masked off.
+ * LEX_KERNEL keeps ASan from flagging those reads.
+ */
+#if defined(__clang__) || defined(__GNUC__)
+#define LEX_KERNEL __attribute__((no_sanitize_address))
+#else
+#define LEX_KERNEL
+#endif
+
+#if defined(__AVX2__)
+
+#define LEX_VECTOR_SIZE 32
+typedef __m256i Lex_Vector;
+
+LEX_KERNEL inline Lex_Vector lex_load(const char *p) { return _mm256_load_si256((const __m256i *)p); }
+inline Lex_Vector lex_set(char ch) { return _mm256_set1_epi8(ch); }
+inline u32 lex_mask(Lex_Vector v) { return (u32)_mm256_movemask_epi8(v); }
+inline Lex_Vector lex_eq(Lex_Vector a, Lex_Vector b) { return _mm256_cmpeq_epi8(a, b); }
+inline Lex_Vector lex_gt(Lex_Vector a, Lex_Vector b) { return _mm256_cmpgt_epi8(a, b); }
+inline Lex_Vector lex_and(Lex_Vector a, Lex_Vector b) { return _mm256_and_si256(a, b); }
+inline Lex_Vector lex_or(Lex_Vector a, Lex_Vector b) { return _mm256_or_si256(a, b); }
+
+#elif defined(__SSE2__)
+
+#define LEX_VECTOR_SIZE 16
+typedef __m128i Lex_Vector;
+
+LEX_KERNEL inline Lex_Vector lex_load(const char *p) { return _mm_load_si128((const __m128i *)p); }
+inline Lex_Vector lex_set(char ch) { return _mm_set1_epi8(ch); }
+inline u32 lex_mask(Lex_Vector v) { return (u32)_mm_movemask_epi8(v); }
+inline Lex_Vector lex_eq(Lex_Vector a, Lex_Vector b) { return _mm_cmpeq_epi8(a, b); }
+inline Lex_Vector lex_gt(Lex_Vector a, Lex_Vector b) { return _mm_cmpgt_epi8(a, b); }
+inline Lex_Vector lex_and(Lex_Vector a, Lex_Vector b) { return _mm_and_si128(a, b); }
+inline Lex_Vector lex_or(Lex_Vector a, Lex_Vector b) { return _mm_or_si128(a, b); }
+
+#endif
+
+#ifdef LEX_VECTOR_SIZE
+
+#define LEX_ALL_LANES ((u32)((1ull << LEX_VECTOR_SIZE) - 1))
+
+// lo <= v <= hi, only meaningful for 0 <= lo, hi < 128
+inline Lex_Vector lex_in_range(Lex_Vector v, char lo, char hi) {
+    return lex_and(lex_gt(v, lex_set(lo - 1)), lex_gt(lex_set(hi + 1), v));
+}
+
+inline u32 space_mask(Lex_Vector v) {
+    return lex_mask(lex_or(lex_eq(v, lex_set(' ')), lex_in_range(v, '\t', '\r')));
+}
+
+inline u32 ident_mask(Lex_Vector v) {
+    auto letters = lex_or(lex_in_range(v, 'a', 'z'), lex_in_range(v, 'A', 'Z'));
+    auto rest    = lex_or(lex_in_range(v, '0', '9'), lex_eq(v, lex_set('_')));
+    return lex_mask(lex_or(letters, rest));
+}
+
+inline u32 line_end_mask(Lex_Vector v) {
+    return lex_mask(lex_or(lex_eq(v, lex_set('\n')), lex_eq(v, lex_set('\0'))));
+}
+
+// Returns the first byte that is not a space
+LEX_KERNEL internal char *scan_spaces(char *b) {
+    u32 misalign = (uintptr_t)b & (LEX_VECTOR_SIZE - 1);
+    char *p = b - misalign;
+    u32 stop = ~space_mask(lex_load(p)) & (LEX_ALL_LANES << misalign) & LEX_ALL_LANES;
+
+    while (!stop) {
+        p += LEX_VECTOR_SIZE;
+        stop = ~space_mask(lex_load(p)) & LEX_ALL_LANES;
+    }
+
+    return p + __builtin_ctz(stop);
+}
+
+// Returns the first byte after b that cannot continue an identifier
+LEX_KERNEL internal char *scan_ident(char *b) {
+    u32 misalign = (uintptr_t)b & (LEX_VECTOR_SIZE - 1);
+    char *p = b - misalign;
+    u32 stop = ~ident_mask(lex_load(p)) & (LEX_ALL_LANES << misalign) & LEX_ALL_LANES;
+
+    while (!stop) {
+        p += LEX_VECTOR_SIZE;
+        stop = ~ident_mask(lex_load(p)) & LEX_ALL_LANES;
+    }
+
+    return p + __builtin_ctz(stop);
+}
+
+// Returns the '\n' or '\0' that ends the line b is on
+LEX_KERNEL internal char *scan_line_end(char *b) {
+    u32 misalign = (uintptr_t)b & (LEX_VECTOR_SIZE - 1);
+    char *p = b - misalign;
+    u32 stop = line_end_mask(lex_load(p)) & (LEX_ALL_LANES << misalign) & LEX_ALL_LANES;
+
+    while (!stop) {
+        p += LEX_VECTOR_SIZE;
+        stop = line_end_mask(lex_load(p));
+    }
+
+    return p + __builtin_ctz(stop);
+}
+
+#else
+
+internal bool is_space(char c) {
+    return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') || (c == '\v') || (c == '\f');
+}
+
 internal bool continues_ident(char c) {
     return starts_ident(c) || (c >= '0' && c <= '9');
 }
 
+internal char *scan_spaces(char *b) {
+    while (is_space(*b)) b++;
+    return b;
+}
+
+internal char *scan_ident(char *b) {
+    while (continues_ident(*b)) b++;
+    return b;
+}
+
+internal char *scan_line_end(char *b) {
+    while (*b && *b != '\n') b++;
+    return b;
+}
+
+#endif
+
+// FNV-1a
+internal u32 hash_string(const char *data, u32 length) {
+    u32 hash = 2166136261u;
+    for (u32 i = 0; i < length; i++) {
+        hash = (hash ^ (u8)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// @note: data must outlive the table, we don't copy names.
+Atom Atom_Table::intern(char *data, u32 length) {
+    if ((names.size() + 1) * 2 > capacity) {
+        grow();
+    }
+
+    u32 hash = hash_string(data, length);
+    u32 mask = capacity - 1;
+
+    for (u32 i = hash & mask; ; i = (i + 1) & mask) {
+        Slot *slot = slots + i;
+
+        if (slot->atom == 0) {
+            String name;
+            name.data   = data;
+            name.length = length;
+
+            slot->hash = hash;
+            slot->atom = names.size() + 1;
+            names.push_back(name);
+
+            Atom atom;
+            atom.id = slot->atom - 1;
+            return atom;
+        }
+
+        if (slot->hash == hash) {
+            String name = names[slot->atom - 1];
+            if (name.length == length && memcmp(name.data, data, length) == 0) {
+                Atom atom;
+                atom.id = slot->atom - 1;
+                return atom;
+            }
+        }
+    }
+}
+
+void Atom_Table::grow() {
+    u32 new_capacity = capacity ? capacity * 2 : (1 << 16);
+    auto new_slots = (Slot *)calloc(new_capacity, sizeof(Slot));
+    u32 mask = new_capacity - 1;
+
+    for (u32 i = 0; i < capacity; i++) {
+        if (slots[i].atom == 0) continue;
+
+        u32 j = slots[i].hash & mask;
+        while (new_slots[j].atom) j = (j + 1) & mask;
+        new_slots[j] = slots[i];
+    }
+
+    free(slots);
+    slots    = new_slots;
+    capacity = new_capacity;
+}
+
 Lexer::Lexer(char *b) {
     buffer = source_text = b;
 }
@@ -56,133 +288,213 @@ void Lexer::tokenize() {
     char *b = buffer;
 
     // compute offsets for the start of each line
-    u32 count = 0;
-    line_offset.push_back(0);
-    while (*b) {
-        if (*b == '\n') {
-            line_offset.push_back(count+1);
-        }
-        count++;
-        b++;
+    line_offset.push_back(b - source_text);
+    while (*(b = scan_line_end(b))) {
+        b++; // skip \n
+        if (end && b >= end) break;
+        line_offset.push_back(b - source_text);
     }
 
     while (true) {
         Token t = next_token();
-        tokens.push_back(t);
+
+        token_types.push_back(t.type);
+        token_offsets.push_back(t.offset);
+        token_values.push_back(t.type == Token::IDENTIFIER ? t.atom.id : t.int_value);
+
         if (t.type == Token::END) break;
     }
 }
 
+/* @note
+ * Tokens never span lines, so a large file can be cut into chunks at line
+ * starts and each chunk lexed on its own. Every chunk gets a private atom
+ * table; afterwards its names are interned into the real table in chunk
+ * order, which hands out the same atom ids the serial lexer would have.
+ * Offsets are global, so line numbers don't need fixing up.
+ */
+void Lexer::tokenize_parallel(u32 thread_count) {
+    const u32 min_chunk_size = 256 * 1024;
+
+    assert(buffer == source_text && token_types.size() == 0);
+
+    u64 size = strlen(source_text);
+    u32 chunk_count = thread_count * 4;
+    if (chunk_count > size / min_chunk_size) chunk_count = size / min_chunk_size;
+
+    if (thread_count <= 1 || chunk_count <= 1) {
+        tokenize();
+        return;
+    }
+
+    // cut at the line start that follows every size/chunk_count bytes
+    Array<char *> starts;
+    starts.push_back(source_text);
+    for (u32 i = 1; i < chunk_count; i++) {
+        char *b = source_text + size * i / chunk_count;
+        if (b < starts.back()) b = starts.back();
+
+        b = scan_line_end(b);
+        if (*b == '\0') break;
+        starts.push_back(b + 1);
+    }
+    chunk_count = starts.size();
+
+    Array<Lexer *> chunks(chunk_count);
+    Array<Atom_Table> chunk_atoms(chunk_count);
+
+    parallel_for(chunk_count, thread_count, [&](u32 i, u32) {
+        auto chunk = new Lexer(source_text);
+        chunk->buffer = starts[i];
+        chunk->end    = (i + 1 < chunk_count) ? starts[i+1] : nullptr;
+        chunk->atoms  = &chunk_atoms[i];
+        chunk->tokenize();
+        chunks[i] = chunk;
+    });
+
+    // intern in chunk order, and work out where each chunk goes
+    Array<Array<u32>> atom_remap(chunk_count);
+    Array<u32> first_token(chunk_count + 1), first_line(chunk_count + 1);
+    first_token[0] = first_line[0] = 0;
+
+    for (u32 i = 0; i < chunk_count; i++) {
+        for (auto name : chunk_atoms[i].names) {
+            atom_remap[i].push_back(atoms->intern(name.data, name.length).id);
+        }
+        free(chunk_atoms[i].slots);
+
+        // every chunk but the last one drops its END
+        u32 token_count = chunks[i]->token_types.size();
+        if (i + 1 < chunk_count) token_count--;
+
+        first_token[i+1] = first_token[i] + token_count;
+        first_line[i+1]  = first_line[i] + chunks[i]->line_offset.size();
+    }
+
+    token_types.resize(first_token[chunk_count]);
+    token_offsets.resize(first_token[chunk_count]);
+    token_values.resize(first_token[chunk_count]);
+    line_offset.resize(first_line[chunk_count]);
+
+    parallel_for(chunk_count, thread_count, [&](u32 i, u32) {
+        auto chunk = chunks[i];
+        u32 t = first_token[i];
+
+        for (u32 j = 0; j < first_token[i+1] - first_token[i]; j++, t++) {
+            token_types[t]   = chunk->token_types[j];
+            token_offsets[t] = chunk->token_offsets[j];
+            token_values[t]  = chunk->token_values[j];
+
+            if (token_types[t] == Token::IDENTIFIER) {
+                token_values[t] = atom_remap[i][token_values[t]];
+            }
+        }
+
+        for (u32 j = 0; j < chunk->line_offset.size(); j++) {
+            line_offset[first_line[i] + j] = chunk->line_offset[j];
+        }
+
+        delete chunk;
+    });
+
+    buffer = source_text + size;
+}
+
 Token Lexer::next_token() {
 
     // skip comments and spaces
     while(true) {
-        char *b = buffer;
-
-        while(is_space(*b)) b++;
+        buffer = scan_spaces(buffer);
 
-        if (*b == '/' && *(b+1) == '/') {
-            while(*b != '\n') b++;
-            b++; // skip \n
+        if (*buffer == '/' && *(buffer+1) == '/') {
+            buffer = scan_line_end(buffer);
+        } else {
+            break;
         }
-
-        if (b == buffer) break;
-        advance(b - buffer);
     }
 
     char ch = *buffer;
+    u32 offset = buffer - source_text;
+
+    if (end && buffer >= end) {
+        return make_token(Token::END, offset);
+    }
 
     if (ch >= '0' && ch <= '9') {
-        Token i = make_token(Token::INTEGER, l, c);
+        Token i = make_token(Token::INTEGER, offset);
         char *b;
         i.int_value = strtoul(buffer, &b, 10);
         advance(b - buffer);
         return i;
-    } else if (starts_ident(ch)) {
-        char *end = buffer;
+    } else if (starts_ident(ch) || (ch == '@' && starts_ident(*(buffer+1)))) {
+        // directives are lexed like identifiers with a leading '@'
+        char *end = scan_ident(buffer + 1);
+        size_t length = end - buffer;
 
-        while (*end) {
-            if (continues_ident(*end)) end++;
-            else break;
+        u32 type = lookup_keyword(buffer, length);
+        if (type != Token::IDENTIFIER) {
+            advance(length);
+            return make_token(type, offset);
         }
 
-        size_t length = end - buffer;
-
-        for (u32 i = 0; i < (Token::KEYWORD_END - Token::KEYWORD_START); i++) {
-            // @Performance
-            if (strncmp(buffer, keywords[i], strlen(keywords[i])) == 0) {
-                buffer += length;
-                return make_token(Token::KEYWORD_START + i, l, c);
-            }
+        if (ch == '@') {
+            // unknown directive, leave the '@' to the parser
+            advance(1);
+            return make_token((u32)ch, offset);
         }
 
         // otherwise it's an identifier
         assert(length != 0);
-        auto ident = (char *)malloc(length+1);
 
-        strncpy(ident, buffer, length);
-        ident[length] = '\0';
-
-        Token id = make_token(Token::IDENTIFIER, l, c);
-        id.str_value = ident;
+        Token id = make_token(Token::IDENTIFIER, offset);
+        id.atom = atoms->intern(buffer, length);
 
         advance(length);
         return id;
 
     } else if (*buffer == '-' && *(buffer+1) == '>') {
         advance(2);
-        return make_token(Token::ARROW, l, c);
+        return make_token(Token::ARROW, offset);
     } else {
         advance(1);
-        return make_token((u32)ch, l, c);
+        return make_token((u32)ch, offset);
     }
 }
 
-Token Lexer::token() {
-    return tokens[token_index];
-}
-
-Token Lexer::peek(u32 lookahead) {
-    u32 i = token_index + lookahead;
+Token Lexer::get_token(u32 i) {
+    Token t = make_token(token_types[i], token_offsets[i]);
 
-    if (i >= tokens.size()) {
-        i = tokens.size() - 1;
+    if (t.type == Token::IDENTIFIER) {
+        t.atom.id = (u32)token_values[i];
+    } else {
+        t.int_value = token_values[i];
     }
 
-    return tokens[i];
-}
-
-void Lexer::eat() {
-    token_index++;
+    return t;
 }
 
-void Lexer::expect(u32 type) {
-    if (token().type != type) {
-        // @TODO: error reporting
-        report_error("unexpected token");
-    }
+void Lexer::advance(u32 count) {
+    buffer += count;
 }
 
-void Lexer::expect_and_eat(u32 type) {
-    expect(type);
-    eat();
-}
+// Finds the line (1-based) and column of a byte offset in the source text
+void Lexer::get_line_column(u32 offset, u32 *l, u32 *c) {
+    u32 lo = 0, hi = line_offset.size();
 
-// @cleanup, the overhead for error reporting seems too heavy
-void Lexer::advance(u32 count) {
-    while (count--) {
-        c++;
-        if (*buffer == '\n') {
-            l++; 
-            c = 0;
-        }
-        buffer++;
+    // last line that starts at or before the offset
+    while (hi - lo > 1) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (line_offset[mid] <= offset) lo = mid;
+        else hi = mid;
     }
+
+    *l = lo + 1;
+    *c = offset - line_offset[lo];
 }
 
-void Lexer::report_error(const char *error_message) {
-    u32 error_l = token().l;
-    u32 error_c = token().c;
+void Lexer::report_error(u32 offset, const char *error_message) {
+    u32 error_l, error_c;
+    get_line_column(offset, &error_l, &error_c);
 
     printf("first.un:%u ", error_l);
     red_text();
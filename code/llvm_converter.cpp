@@ -66,45 +66,82 @@ struct LLVM_Converter {
     LLVMContext *ctx;
     Module      *module;
     IRBuilder<> *builder;
-    Array<BasicBlock *> blocks;
-};
 
-internal Value *get_previously_converted_value(LLVM_Converter *c, IL::Value *value_il) {
+    // of the function being converted, indexed like the IL function's
+    IL::Function *func_il;
+    Array<BasicBlock *> blocks;
+    Array<Value *> values; // by value number
+    Array<IL::Value_Id> phis; // get their incoming values once everything is converted
 
-    assert(value_il);
+    // every function of the module, declared up front, in module order
+    Array<Function *> functions;
+};
 
-    if (auto constant = value_il->as<IL::Constant>()) {
-        return ConstantInt::get(*c->ctx, 
-                APInt(32, constant->value, /* is signed */ true));
+// AST types are canonical, so each one is converted once and cached on it
+internal llvm::Type *convert_type(LLVM_Converter *c, AST::Type *type) {
+    if (type->llvm_type) {
+        return type->llvm_type;
     }
 
-    return value_il->llvm_value;
-
-}
-
-internal llvm::Type *convert_type(LLVM_Converter *c, AST::Type *type) {
     if (type->type == AST::Type::VOID) {
-        return llvm::Type::getVoidTy(*c->ctx);
+        type->llvm_type = llvm::Type::getVoidTy(*c->ctx);
     } else if (type->type == AST::Type::INTEGER) {
         auto int_type = (AST::Integer_Type *) type;
-        return llvm::IntegerType::get(*c->ctx, int_type->size * 8);
+        type->llvm_type = llvm::IntegerType::get(*c->ctx, int_type->size * 8);
+    } else if (type->type == AST::Type::FUNCTION) {
+        auto func_type = (AST::Function_Type *) type;
+
+        Array<llvm::Type *> arg_type;
+        for (auto arg : func_type->arguments) {
+            arg_type.push_back(convert_type(c, arg));
+        }
+
+        type->llvm_type = FunctionType::get(
+            convert_type(c, func_type->return_type), arg_type, false);
     } else {
         assert(false && "converting unknown type to LLVM IR");
         return nullptr;
     }
+
+    return type->llvm_type;
 }
 
-internal void convert_value(LLVM_Converter *c, Function *function, IL::Value *value_il) {
+internal Value *get_previously_converted_value(LLVM_Converter *c, IL::Value_Id n) {
+
+    assert(n != IL::no_value);
 
-    // assert(value_il->llvm_value == nullptr);
+    if (c->values[n]) return c->values[n];
+
+    // constants are numbered once per function, so convert each one once too
+    auto value_il = c->func_il->value(n);
 
     if (auto constant = value_il->as<IL::Constant>()) {
+        c->values[n] = ConstantInt::get(convert_type(c, value_il->value_type), constant->value);
+    } else if (value_il->type == IL::Value::UNDEF) {
+        c->values[n] = UndefValue::get(convert_type(c, value_il->value_type));
+    }
 
-    } else if (auto alloca = value_il->as<IL::Alloca>()) {
+    return c->values[n];
 
-        alloca->llvm_value = c->builder->CreateAlloca(
-                   llvm::Type::getInt32Ty(*c->ctx),
-                   ConstantInt::get(*c->ctx, APInt(32, (u64)alloca->size, false)));
+}
+
+internal void convert_value(LLVM_Converter *c, Function *function, IL::Value_Id n) {
+
+    auto value_il = c->func_il->value(n);
+
+    if (value_il->type == IL::Value::CONSTANT) {
+        // built where it's used, by get_previously_converted_value
+    } else if (value_il->type == IL::Value::UNDEF) {
+        // built where it's used, by get_previously_converted_value
+    } else if (auto phi = value_il->as<IL::Phi>()) {
+
+        // incoming values can come from blocks we haven't converted yet
+        c->values[n] = c->builder->CreatePHI(convert_type(c, value_il->value_type), phi->incoming_count);
+        c->phis.push_back(n);
+
+    } else if (value_il->type == IL::Value::ALLOCA) {
+
+        c->values[n] = c->builder->CreateAlloca(convert_type(c, value_il->value_type));
 
     } else if (auto bi = value_il->as<IL::Binary_Expression>()) {
 
@@ -112,147 +149,246 @@ internal void convert_value(LLVM_Converter *c, Function *function, IL::Value *va
         auto lhs = get_previously_converted_value(c, bi->lhs);
         auto rhs = get_previously_converted_value(c, bi->rhs);
 
+        bool nuw = bi->flags & IL::Binary_Expression::NO_UNSIGNED_WRAP;
+        bool nsw = bi->flags & IL::Binary_Expression::NO_SIGNED_WRAP;
+
+        // the high half of the product, widened to twice the width and
+        // back, which the backend turns into a single multiply
+        auto multiply_high = [&](bool is_signed) {
+            auto type = cast<IntegerType>(lhs->getType());
+            u32 bits = type->getBitWidth();
+            auto wide = llvm::IntegerType::get(*c->ctx, 2 * bits);
+
+            auto wide_lhs = is_signed ? c->builder->CreateSExt(lhs, wide) : c->builder->CreateZExt(lhs, wide);
+            auto wide_rhs = is_signed ? c->builder->CreateSExt(rhs, wide) : c->builder->CreateZExt(rhs, wide);
+
+            auto product = c->builder->CreateMul(wide_lhs, wide_rhs);
+            return c->builder->CreateTrunc(c->builder->CreateLShr(product, bits), type);
+        };
+
+        // comparisons give an i32, 0 or 1
+        auto int32 = llvm::Type::getInt32Ty(*c->ctx);
+
         switch (bi->op) {
-            case '+': binary_value = c->builder->CreateAdd(lhs, rhs); break;
-            case '-': binary_value = c->builder->CreateSub(lhs, rhs); break;
-            case '*': binary_value = c->builder->CreateMul(lhs, rhs); break;
-            //case '/': binary_value = c->builder->CreateAdd(lhs, rhs); break;
-            case '<': binary_value = c->builder->CreateICmpSLT(lhs, rhs); break;
+            case '+': binary_value = c->builder->CreateAdd(lhs, rhs, "", nuw, nsw); break;
+            case '-': binary_value = c->builder->CreateSub(lhs, rhs, "", nuw, nsw); break;
+            case '*': binary_value = c->builder->CreateMul(lhs, rhs, "", nuw, nsw); break;
+            case '/': binary_value = c->builder->CreateSDiv(lhs, rhs); break;
+            case '%': binary_value = c->builder->CreateSRem(lhs, rhs); break;
+            case '&': binary_value = c->builder->CreateAnd(lhs, rhs); break;
+            case '<': binary_value = c->builder->CreateZExt(c->builder->CreateICmpSLT(lhs, rhs), int32); break;
+
+            case IL::Binary_Expression::UNSIGNED_DIV:           binary_value = c->builder->CreateUDiv(lhs, rhs); break;
+            case IL::Binary_Expression::UNSIGNED_MOD:           binary_value = c->builder->CreateURem(lhs, rhs); break;
+            case IL::Binary_Expression::SHIFT_LEFT:             binary_value = c->builder->CreateShl(lhs, rhs);  break;
+            case IL::Binary_Expression::SHIFT_RIGHT:            binary_value = c->builder->CreateAShr(lhs, rhs); break;
+            case IL::Binary_Expression::UNSIGNED_SHIFT_RIGHT:   binary_value = c->builder->CreateLShr(lhs, rhs); break;
+            case IL::Binary_Expression::MULTIPLY_HIGH:          binary_value = multiply_high(true);  break;
+            case IL::Binary_Expression::UNSIGNED_MULTIPLY_HIGH: binary_value = multiply_high(false); break;
+            case IL::Binary_Expression::UNSIGNED_LESS:          binary_value = c->builder->CreateZExt(c->builder->CreateICmpULT(lhs, rhs), int32); break;
+
             default: assert(false && "converting unknown binary instruction to LLVM IR");
         }
 
-        bi->llvm_value = binary_value;
+        c->values[n] = binary_value;
 
     } else if (auto un = value_il->as<IL::Unary_Expression>()) {
 
         Value *unary_value;
         auto operand = get_previously_converted_value(c, un->operand);
+        auto type    = convert_type(c, value_il->value_type);
 
         switch (un->op) {
-            case '-': unary_value = c->builder->CreateSub(ConstantInt::get(*c->ctx, APInt(32, 0, true)), operand); break;
+            case '-': unary_value = c->builder->CreateNeg(operand); break;
             case '+': unary_value = operand; break;
+            case IL::Unary_Expression::SIGN_EXTEND: unary_value = c->builder->CreateSExt(operand, type);  break;
+            case IL::Unary_Expression::ZERO_EXTEND: unary_value = c->builder->CreateZExt(operand, type);  break;
+            case IL::Unary_Expression::TRUNCATE:    unary_value = c->builder->CreateTrunc(operand, type); break;
             default: assert(false && "converting unknown unary instruction to LLVM IR");
         }
 
-        un->llvm_value = unary_value;
+        c->values[n] = unary_value;
 
     } else if (auto call = value_il->as<IL::Function_Call>()) {
-        Function *callee_function = c->module->getFunction(call->name);
+        Function *callee_function = c->functions[call->callee];
 
         assert(callee_function);
-        assert(call->arguments.size() == callee_function->arg_size());
+        assert(call->argument_count == callee_function->arg_size());
 
         Array<Value *> arguments;
-        for (auto arg_il : call->arguments) {
+        for (auto arg_il : c->func_il->call_arguments(call)) {
             auto arg_value = get_previously_converted_value(c, arg_il);
             arguments.push_back(arg_value);
         }
 
-        call->llvm_value = c->builder->CreateCall(callee_function, arguments);
+        c->values[n] = c->builder->CreateCall(callee_function, arguments);
 
     } else if (auto load = value_il->as<IL::Load>()) {
 
         auto base = get_previously_converted_value(c, load->base);
-        load->llvm_value = 
-            c->builder->CreateLoad(llvm::Type::getInt32Ty(*c->ctx), base);
+        c->values[n] =
+            c->builder->CreateLoad(convert_type(c, value_il->value_type), base);
 
     } else if (auto store = value_il->as<IL::Store>()) {
 
         auto source = get_previously_converted_value(c, store->source);
         auto base   = get_previously_converted_value(c, store->base);
-        store->llvm_value = c->builder->CreateStore(source, base);
+        c->values[n] = c->builder->CreateStore(source, base);
 
     } else if (auto br = value_il->as<IL::Branch>()) {
-        BasicBlock *true_target  = c->blocks[br->true_target->i];
-        BasicBlock *false_target = c->blocks[br->false_target->i];
+        BasicBlock *true_target  = c->blocks[br->true_target];
+        BasicBlock *false_target = c->blocks[br->false_target];
 
         auto cond = get_previously_converted_value(c, br->condition);
+        cond = c->builder->CreateICmpNE(cond, ConstantInt::get(cond->getType(), 0));
 
         c->builder->CreateCondBr(cond, true_target, false_target);
     } else if (auto jmp = value_il->as<IL::Jump>()) {
-        BasicBlock *target = c->blocks[jmp->target->i];
+        BasicBlock *target = c->blocks[jmp->target];
 
         c->builder->CreateBr(target);
     } else if (auto ret = value_il->as<IL::Return>()) {
         
         Value *return_value = nullptr;
-        if (ret->return_value) {
+        if (ret->return_value != IL::no_value) {
             return_value = get_previously_converted_value(c, ret->return_value);
         }
 
         c->builder->CreateRet(return_value);
+    } else if (auto arg = value_il->as<IL::Argument>()) {
+
+        c->values[n] = function->getArg(arg->index);
     } else {
         assert(false && "converting unkonwn IL values to LLVM IR");
     }
 
 }
 
-internal Function *convert_function(LLVM_Converter *c, IL::Function *func_il) {
-    auto arg_count = func_il->ast->func_type->arguments.size();
-    //Array<llvm::Type *> arg_type(arg_count, llvm::Type::getInt32Ty(*c->ctx));
-    Array<llvm::Type *> arg_type;
-    for (auto arg : func_il->ast->func_type->arguments) {
-        arg_type.push_back(convert_type(c, arg));
-    }
-    FunctionType *ft = FunctionType::get(
-        convert_type(c, func_il->ast->func_type->return_type), arg_type, false);
+internal Function *declare_function(LLVM_Converter *c, AST::Function *func_ast) {
+    auto ft = cast<FunctionType>(convert_type(c, func_ast->func_type));
 
+    String name = atom_table.name(func_ast->name);
     Function *f = Function::Create(ft, Function::ExternalLinkage,
-                                   func_il->ast->name, c->module);
+                                   StringRef(name.data, name.length), c->module);
+    c->functions[func_ast->index] = f;
+
+    // so LLVM's own inliner at -O2 agrees with ours
+    if (func_ast->inlining == AST::Function::INLINE_ALWAYS) f->addFnAttr(Attribute::AlwaysInline);
+    if (func_ast->inlining == AST::Function::INLINE_NEVER)  f->addFnAttr(Attribute::NoInline);
 
-    if (func_il->ast->body == nullptr) {
+    return f;
+}
+
+// The function has to be declared already, see declare_function
+internal Function *convert_function(LLVM_Converter *c, IL::Function *func_il) {
+    Function *f = c->functions[func_il->ast->index];
+    assert(f);
+
+    if (func_il->ast->body == AST::no_node || func_il->removed) {
         return f;
     }
 
+    c->func_il = func_il;
+    c->values.assign(func_il->value_count(), nullptr);
+    c->phis.clear();
+
     c->blocks.clear();
     for (u32 i = 0; i < func_il->blocks.size(); i++) {
         auto bb = BasicBlock::Create(*c->ctx, "", f);
         c->blocks.push_back(bb);
     }
 
-    for (u32 bb_index = 0;
-         bb_index < func_il->blocks.size();
-         bb_index++) {
+    // definitions before uses: dominators come first in reverse postorder,
+    // whatever order the IL passes left the blocks in
+    auto dominators = IL::get_dominators(func_il);
+
+    Array<u32> order = dominators->reverse_postorder;
+    for (u32 bb_index = 0; bb_index < func_il->blocks.size(); bb_index++) {
+        if (!IL::is_reachable(dominators, bb_index)) order.push_back(bb_index);
+    }
+
+    for (auto bb_index : order) {
 
         auto bb = c->blocks[bb_index];
-        auto bb_il = func_il->blocks[bb_index];
+        auto &bb_il = func_il->blocks[bb_index];
 
         c->builder->SetInsertPoint(bb);
 
-        for (auto instruction_il : bb_il->instructions) {
+        for (auto instruction_il : bb_il.instructions) {
             convert_value(c, f, instruction_il);
         }
     }
 
+    for (auto n : c->phis) {
+        auto phi = func_il->value(n)->as<IL::Phi>();
+        auto phi_node = cast<PHINode>(c->values[n]);
+
+        for (u32 i = 0; i < phi->incoming_count; i++) {
+            auto incoming = func_il->phi_incoming[phi->first_incoming + i];
+            phi_node->addIncoming(get_previously_converted_value(c, incoming.value), c->blocks[incoming.block]);
+        }
+    }
+
+    // what the IL passes found out, so LLVM can move, merge and drop calls
+    f->addFnAttr(Attribute::NoUnwind); // nothing here throws
+
+    u32 attributes = func_il->attributes;
+    if (attributes & IL::Function_Attributes::READ_NONE)   f->addFnAttr(Attribute::ReadNone);
+    if (attributes & IL::Function_Attributes::READ_ONLY)   f->addFnAttr(Attribute::ReadOnly);
+    if (attributes & IL::Function_Attributes::NO_RECURSE)  f->addFnAttr(Attribute::NoRecurse);
+    if (attributes & IL::Function_Attributes::WILL_RETURN) f->addFnAttr(Attribute::WillReturn);
+
     verifyFunction(*f);
 
     return f;
 }
 
-internal Module *convert_module(IL::Module *module_il) {
+// Creates the LLVM module and declares every function in it, so bodies can
+// be converted in any order afterwards, calls to later functions included.
+internal void begin_module(LLVM_Converter *c, AST::Module *module_ast) {
 
     // create a new context and module
-    LLVM_Converter converter;
-    converter.ctx     = new LLVMContext;
-    converter.module  = new Module("unamed module", *converter.ctx);
+    c->ctx     = new LLVMContext;
+    c->module  = new Module("unamed module", *c->ctx);
 
     // create IR builder for the module
-    converter.builder = new IRBuilder<>(*converter.ctx);
+    c->builder = new IRBuilder<>(*c->ctx);
 
-    // convert functions
-    for (auto function_il : module_il->functions) {
-        convert_function(&converter, function_il);
+    c->functions.assign(module_ast->functions.size(), nullptr);
+
+    for (auto function_ast : module_ast->functions) {
+        declare_function(c, function_ast);
     }
+}
+
+internal Module *finish_module(LLVM_Converter *c) {
 
     // @FIXME: DONT DEPEND ON GLOBAL VARIABLE
     if (options.optimization_level != 0) {
-        optimize_module(converter.module, options.optimization_level);
+        optimize_module(c->module, options.optimization_level);
     }
 
     printf("\n\n");
-    converter.module->print(errs(), nullptr);
+    c->module->print(errs(), nullptr);
+
+    return c->module;
+}
+
+internal Module *convert_module(AST::Module *module_ast, IL::Module *module_il) {
+    LLVM_Converter converter;
+    begin_module(&converter, module_ast);
+
+    // convert functions
+    for (auto function_il : module_il->functions) {
+        convert_function(&converter, function_il);
+    }
+
+    // declared up front with the rest, but nothing calls them anymore
+    for (u32 i = 0; i < module_il->functions.size(); i++) {
+        if (module_il->functions[i]->removed) converter.functions[i]->eraseFromParent();
+    }
 
-    return converter.module;
+    return finish_module(&converter);
 }
 
 // Returns true if succueed
@@ -0,0 +1,82 @@
+// Runs job(i, worker) for every i in [0, count) on up to thread_count threads,
+// the calling thread included as worker 0. Workers pull indices from a shared
+// counter, so uneven jobs still balance out, and worker is below thread_count
+// so callers can keep per-worker state in a plain array.
+template <typename Job>
+internal void parallel_for(u32 count, u32 thread_count, Job job) {
+    if (thread_count > count) thread_count = count;
+
+    if (thread_count <= 1) {
+        for (u32 i = 0; i < count; i++) job(i, 0);
+        return;
+    }
+
+    std::atomic<u32> next_index(0);
+
+    auto worker = [&](u32 worker_index) {
+        u32 i;
+        while ((i = next_index++) < count) job(i, worker_index);
+    };
+
+    Array<std::thread> threads;
+    for (u32 t = 1; t < thread_count; t++) {
+        threads.emplace_back(worker, t);
+    }
+
+    worker(0);
+
+    for (auto &thread : threads) thread.join();
+}
+
+// 0 means one thread per core
+internal u32 resolve_thread_count(u32 thread_count) {
+    if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
+    return thread_count ? thread_count : 1;
+}
+
+// A fixed size FIFO between pipeline stages. push blocks while the queue is
+// full and pop blocks while it's empty, so a fast producer can't run
+// arbitrarily far ahead of its consumer. Once the producer calls close(),
+// pop drains what's left and then returns false.
+template <typename T>
+struct Bounded_Queue {
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full;
+
+    Array<T> items; // ring buffer
+    u32 head  = 0;
+    u32 count = 0;
+    bool closed = false;
+
+    Bounded_Queue(u32 capacity) : items(capacity) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [&] { return count < items.size(); });
+
+        items[(head + count) % items.size()] = item;
+        count++;
+
+        not_empty.notify_one();
+    }
+
+    bool pop(T *item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [&] { return count > 0 || closed; });
+
+        if (count == 0) return false;
+
+        *item = items[head];
+        head = (head + 1) % items.size();
+        count--;
+
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+};
@@ -1,286 +1,452 @@
 
 namespace AST {
 
+// A '{' token and its matching '}'
+struct Token_Range {
+    u32 first, last;
+};
+
+// Finds the token range of every top-level { ... }, which can only be a
+// function body, with one pass over the token types and without parsing.
+// Stops at an unbalanced '}' and drops an unclosed '{', the parser reports
+// those when it gets there.
+internal void find_function_bodies(Lexer *lexer, Array<Token_Range> *bodies) {
+    u32 depth = 0;
+    u32 first = 0;
+
+    for (u32 i = 0; i < lexer->token_types.size(); i++) {
+        u32 type = lexer->token_types[i];
+
+        if (type == '{') {
+            if (depth++ == 0) first = i;
+        } else if (type == '}') {
+            if (depth == 0) break;
+            if (--depth == 0) bodies->push_back({first, i});
+        }
+    }
+}
+
+internal u32 binary_precedence(u32 op) {
+    switch(op) {
+        case '<':
+        case '>': return 1;
+
+        case '+':
+        case '-': return 2;
+
+        case '*':
+        case '/':
+        case '%': return 3;
+
+        default: return 0; // not a binary operator
+    }
+}
+
+/* @note
+ * With more than one thread, parse_module goes over the file twice. The first
+ * pass parses globals and function signatures as before but skips every body
+ * whose range find_function_bodies found, then the skipped bodies are parsed
+ * by parse_deferred_bodies on a pool of worker parsers. A body only adds to
+ * its own scopes and only reads the primitive types of the Type_Pool, so the
+ * workers share nothing but the token stream and the finished module scope.
+ */
 struct Parser {
 
     Lexer *lexer;
+    Arena *arena;
     Module *module;
     Array<Scope *> scope_stack;
+    u32 token_index = 0;
 
-    Type *parse_type() {
-        Token t = lexer->token();
-        lexer->eat();
-        switch(t.type) {
-            case Token::KEYWORD_VOID: return new Void_Type;
-            case Token::KEYWORD_I8  : return new Integer_Type(1);
-            case Token::KEYWORD_I16 : return new Integer_Type(2);
-            case Token::KEYWORD_I32 : return new Integer_Type(4);
-            case Token::KEYWORD_I64 : return new Integer_Type(8);
-            default: lexer->report_error("unknown type"); return nullptr;
+    Node_Pool *nodes; // where the nodes being parsed go
+    Array<Handle> scratch;
+
+    struct Deferred_Body {
+        Function *func;
+        u32 function_index; // in Module::functions
+        Scope *scope;
+        u32 first_token;
+    };
+
+    Array<Token_Range> *bodies = nullptr; // set during the first pass
+    u32 next_body = 0;
+    Array<Deferred_Body> deferred;
+
+    // for iterating through the tokens array
+    Token token() {
+        return lexer->get_token(token_index);
+    }
+
+    Token peek(u32 lookahead = 1) {
+        u32 i = token_index + lookahead;
+
+        if (i >= lexer->token_count()) {
+            i = lexer->token_count() - 1;
         }
+
+        return lexer->get_token(i);
     }
 
-    Expreesion *parse_unary() {
-        
-        u32 op = lexer->token().type;
-        u32 prec;
-        bool is_unary_op = true;
+    void eat() {
+        token_index++;
+    }
 
-        // @TODO: cleanup the prec
-        switch(op) {
-            case '+': prec = 15; break;
-            case '-': prec = 15; break;
-            default: is_unary_op = false;
+    void expect(u32 type) {
+        if (token().type != type) {
+            // @TODO: error reporting
+            report_error("unexpected token");
         }
+    }
 
-        if (is_unary_op) {
-            lexer->eat();
+    void expect_and_eat(u32 type) {
+        expect(type);
+        eat();
+    }
 
-            auto un = new Unary;
-            un->op      = op;
-            un->operand = parse_expression(prec);
-            assert(un->operand);
+    void report_error(const char *error_message) {
+        lexer->report_error(token().offset, error_message);
+    }
 
-            return un;
-        } else if (lexer->token().type == Token::IDENTIFIER && 
-                   lexer->peek().type == '(') {
-            auto call = parse_function_call();
+    Type *parse_type() {
+        auto types = module->types;
 
-            return call;
-        } else if (lexer->token().type == Token::IDENTIFIER) {
-            auto id = new Identifier;
-            id->name = lexer->token().str_value;
+        Token t = token();
+        eat();
+        switch(t.type) {
+            case Token::KEYWORD_VOID: return types->void_type;
+            case Token::KEYWORD_I8  : return types->integer_type(1);
+            case Token::KEYWORD_I16 : return types->integer_type(2);
+            case Token::KEYWORD_I32 : return types->integer_type(4);
+            case Token::KEYWORD_I64 : return types->integer_type(8);
+            case Token::KEYWORD_U8  : return types->integer_type(1, true);
+            case Token::KEYWORD_U16 : return types->integer_type(2, true);
+            case Token::KEYWORD_U32 : return types->integer_type(4, true);
+            case Token::KEYWORD_U64 : return types->integer_type(8, true);
+            default: report_error("unknown type"); return nullptr;
+        }
+    }
 
-            lexer->eat();
+    /* @note
+     * Expressions are parsed with explicit operator and operand stacks
+     * instead of recursing once per operator, because generated code has
+     * expressions tens of thousands of terms deep. Parentheses and calls
+     * are frames on the operator stack, a call's arguments pile up on the
+     * operand stack until its ')' turns them into the call node.
+     */
+    struct Operator_Frame {
+        enum { BINARY_OP, UNARY_OP, PAREN, CALL } kind;
+        u32 op;
+        u32 prec;
 
-            return id;
-        } else if (lexer->token().type == Token::INTEGER) {
-            auto lit = new Int_Literal;
-            lit->value = lexer->token().int_value;
+        // for CALL
+        Atom name;
+        u32 first_operand; // where its arguments start on the operand stack
+    };
 
-            lexer->eat();
+    Array<Operator_Frame> operators;
+    Array<Handle> operands;
 
-            return lit;
-        } else if (lexer->token().type == '(') {
-            lexer->eat();
-            auto expr = parse_expression();
-            assert(expr);
-            lexer->expect_and_eat(')');
+    // Pops operators down to the first frame with lower precedence,
+    // or the innermost parenthesis or call, or operator_base.
+    void reduce(u32 min_prec, u32 operator_base) {
+        while (operators.size() > operator_base) {
+            auto top = operators.back();
 
-            return expr;
-        } else {
-            return nullptr;
-        }
-    }
+            if (top.kind == Operator_Frame::PAREN || top.kind == Operator_Frame::CALL) break;
+            if (top.prec < min_prec) break;
 
-    Expreesion *parse_expression(u32 min_prec = 1) {
-        auto lhs = parse_unary();
+            operators.pop_back();
 
-        if (!lhs) return nullptr;
+            if (top.kind == Operator_Frame::UNARY_OP) {
+                Unary un;
+                un.op      = top.op;
+                un.operand = operands.back();
 
-        while (true) {
+                operands.back() = nodes->push(nodes->unaries, UNARY, un);
+            } else {
+                Binary bi;
+                bi.op  = top.op;
+                bi.rhs = operands.back();
+                operands.pop_back();
+                bi.lhs = operands.back();
 
-            u32 op = lexer->token().type;
-            u32 prec;
-            bool left_assoc = true;
+                operands.back() = nodes->push(nodes->binaries, BINARY, bi);
+            }
+        }
+    }
 
-            bool is_binary_op = true;
+    // Returns no_node if there's no expression here at all
+    Handle parse_expression() {
+        u32 operator_base = operators.size();
+        u32 operand_base  = operands.size();
 
-            switch(op) {
-                case '<':
-                case '>': prec = 1; break;
+        bool want_operand = true;
 
-                case '+':
-                case '-': prec = 2; break;
+        while (true) {
+            Token t = token();
+
+            if (want_operand) {
+                // @TODO: cleanup the prec
+                if (t.type == '+' || t.type == '-') {
+                    eat();
+
+                    Operator_Frame frame = {};
+                    frame.kind = Operator_Frame::UNARY_OP;
+                    frame.op   = t.type;
+                    frame.prec = 15;
+                    operators.push_back(frame);
+                } else if (t.type == Token::IDENTIFIER && peek().type == '(') {
+                    eat(); // eats callee name
+                    eat();
+
+                    Operator_Frame frame = {};
+                    frame.kind = Operator_Frame::CALL;
+                    frame.name = t.atom;
+                    frame.first_operand = operands.size();
+                    operators.push_back(frame);
+                } else if (t.type == '(') {
+                    eat();
+
+                    Operator_Frame frame = {};
+                    frame.kind = Operator_Frame::PAREN;
+                    operators.push_back(frame);
+                } else if (t.type == Token::IDENTIFIER) {
+                    eat();
+                    operands.push_back(nodes->push(nodes->identifiers, IDENTIFIER, t.atom));
+                    want_operand = false;
+                } else if (t.type == Token::INTEGER) {
+                    eat();
+                    operands.push_back(nodes->push(nodes->int_literals, INT_LITERAL, t.int_value));
+                    want_operand = false;
+                } else {
+                    // nothing started yet means there's no expression here
+                    if (operators.size() == operator_base && operands.size() == operand_base) {
+                        return no_node;
+                    }
 
-                case '*':
-                case '/':
-                case '%': prec = 3; break;
+                    report_error("expected an expression");
+                    return no_node;
+                }
 
-                default: is_binary_op = false;
+                continue;
             }
 
-            if (!is_binary_op) break;
+            u32 prec = binary_precedence(t.type);
 
-            if (prec < min_prec) break;
+            if (prec) {
+                eat();
 
-            lexer->eat();
+                // everything is left associative
+                reduce(prec, operator_base);
 
-            u32 next_prec = left_assoc ? (prec+1) : prec;
-            auto rhs = parse_expression(next_prec);
-            assert(rhs);
+                Operator_Frame frame = {};
+                frame.kind = Operator_Frame::BINARY_OP;
+                frame.op   = t.type;
+                frame.prec = prec;
+                operators.push_back(frame);
 
-            auto bi = new Binary;
-            bi->op  = op;
-            bi->lhs = lhs;
-            bi->rhs = rhs;
-            lhs = bi;
-        }
+                want_operand = true;
+                continue;
+            }
 
-        return lhs;
-    }
+            reduce(0, operator_base);
 
-    Function_Call *parse_function_call() {
-        lexer->expect(Token::IDENTIFIER);
+            // a ')' or ',' with no frame of ours open belongs to whoever
+            // called us, same for anything else that can't continue
+            bool in_frame = operators.size() > operator_base;
 
-        auto call = new Function_Call;
-        call->name = lexer->token().str_value;
+            if (in_frame && t.type == ')') {
+                eat();
 
-        lexer->eat(); // eats callee name
-        lexer->expect_and_eat('(');
+                auto frame = operators.back();
+                operators.pop_back();
 
-        while(true) {
-            auto arg = parse_expression();
-            assert(arg);
-            call->arguments.push_back(arg);
+                if (frame.kind == Operator_Frame::CALL) {
+                    Function_Call call;
+                    call.name = frame.name;
+                    call.argument_count = operands.size() - frame.first_operand;
+                    call.first_argument = nodes->push_list(operands.data() + frame.first_operand, call.argument_count);
 
-            if (lexer->token().type == ',') {
-                lexer->eat();
-            } else if (lexer->token().type == ')') {
-                break;
+                    operands.resize(frame.first_operand);
+                    operands.push_back(nodes->push(nodes->calls, FUNCTION_CALL, call));
+                }
+
+                // the parenthesised expression is already on the operand stack
+            } else if (in_frame && t.type == ',' && operators.back().kind == Operator_Frame::CALL) {
+                eat();
+
+                // the argument stays on the operand stack
+                want_operand = true;
+            } else if (in_frame) {
+                expect(')');
             } else {
-                assert(false);
+                break;
             }
         }
 
-        lexer->expect_and_eat(')');
+        assert(operands.size() == operand_base + 1);
+
+        auto expr = operands.back();
+        operands.pop_back();
 
-        return call;
+        return expr;
     }
 
-    Node *parse_statement() {
+    Handle parse_statement() {
 
-        if (lexer->peek().type == ':') {
+        if (peek().type == ':') {
             auto var = parse_variable();
-            lexer->expect_and_eat(';');
-            return var;
-        } else if (lexer->token().type == Token::KEYWORD_RETURN) {
-            lexer->eat();
+            expect_and_eat(';');
+            return nodes->push(nodes->variables, VARIABLE, var);
+        } else if (token().type == Token::KEYWORD_RETURN) {
+            eat();
 
-            auto ret = new Return;
-            ret->return_value = nullptr;
+            Return ret;
+            ret.return_value = no_node;
 
-            if (lexer->token().type != ';') {
-                ret->return_value = parse_expression();
-                assert(ret->return_value);
+            if (token().type != ';') {
+                ret.return_value = parse_expression();
+                assert(ret.return_value != no_node);
             }
 
-            lexer->expect_and_eat(';');
-            return ret;
-        } else if (lexer->token().type == Token::KEYWORD_WHILE) {
-            lexer->eat();
+            expect_and_eat(';');
+            return nodes->push(nodes->returns, RETURN, ret);
+        } else if (token().type == Token::KEYWORD_WHILE) {
+            eat();
 
-            auto wh = new While;
-            wh->condition = parse_expression();
-            wh->body = parse_block();
+            While wh;
+            wh.condition = parse_expression();
+            wh.body = parse_block();
 
-            return wh;
+            return nodes->push(nodes->whiles, WHILE, wh);
         } else {
             auto expr = parse_expression();
-            if (!expr) return nullptr;
+            if (expr == no_node) return no_node;
 
             // is an assignment?
-            if (lexer->token().type == '=') {
-                lexer->eat();
-                auto assign = new Assign;
-                assign->lhs = expr;
-                assign->rhs = parse_expression();
-
-                lexer->expect_and_eat(';');
-                return assign;
+            if (token().type == '=') {
+                eat();
+                Assign assign;
+                assign.lhs = expr;
+                assign.rhs = parse_expression();
+
+                expect_and_eat(';');
+                return nodes->push(nodes->assigns, ASSIGN, assign);
             } else {
-                lexer->expect_and_eat(';');
+                expect_and_eat(';');
                 return expr;
             }
         }
     }
 
-    Block *parse_block(Scope *scope = nullptr) {
-        lexer->expect_and_eat('{');
+    Handle parse_block(Scope *scope = nullptr) {
+        expect_and_eat('{');
         
-        auto block = new Block;
-        block->scope = scope;
-        if (!block->scope) {
-            block->scope = new Scope;
-            block->scope->parent = scope_stack.back();
+        Block block;
+        block.scope = scope;
+        if (!block.scope) {
+            block.scope = arena->make<Scope>(arena);
+            block.scope->parent = scope_stack.back();
         }
 
-        scope_stack.push_back(block->scope);
-        while(auto stmt = parse_statement()) {
-            block->statements.push_back(stmt);
+        // nested blocks use the scratch stack on top of us, so our statements
+        // are only copied into the pool once the whole block is parsed
+        u32 scratch_start = scratch.size();
+
+        scope_stack.push_back(block.scope);
+        while(true) {
+            auto stmt = parse_statement();
+            if (stmt == no_node) break;
+            scratch.push_back(stmt);
         }
         scope_stack.pop_back();
 
-        lexer->expect_and_eat('}');
+        expect_and_eat('}');
+
+        block.statement_count = scratch.size() - scratch_start;
+        block.first_statement = nodes->push_list(scratch.data() + scratch_start, block.statement_count);
+        scratch.resize(scratch_start);
 
-        return block;
+        return nodes->push(nodes->blocks, BLOCK, block);
     }
 
     Variable *parse_variable() {
-        lexer->expect(Token::IDENTIFIER);
+        expect(Token::IDENTIFIER);
 
         assert(scope_stack.size() != 0);
         auto scope = scope_stack.back();
 
-        auto variable = new Variable;
-        scope->variables.push_back(variable);
-        variable->name = lexer->token().str_value;
-        variable->initial_value = nullptr;
+        auto variable = arena->make<Variable>();
+        variable->name = token().atom;
+        variable->initial_value = no_node;
 
-        lexer->eat();
+        // the scope index hashes the name, so it has to be set by now
+        scope->add_variable(variable);
 
-        lexer->expect_and_eat(':');
+        eat();
+
+        expect_and_eat(':');
         variable->var_type = parse_type();
 
-        if (lexer->token().type == '=') {
-            lexer->eat();
+        if (token().type == '=') {
+            eat();
             variable->initial_value = parse_expression();
-            assert(variable->initial_value);
+            assert(variable->initial_value != no_node);
         }
 
         return variable;
     }
 
     Function *parse_function() {
-        lexer->expect_and_eat(Token::KEYWORD_FUNC);
+        expect_and_eat(Token::KEYWORD_FUNC);
 
-        auto func = new Function;
+        auto func = arena->make<Function>(arena);
+        func->nodes = nullptr;
+        func->body  = no_node;
 
-        if (is_keyword(lexer->token())) {
+        if (is_keyword(token())) {
             while (true) {
-                Token t = lexer->token();
+                Token t = token();
                 if (t.type == Token::DIRECTIVE_C_FUNCTION) {
-                    lexer->eat();
+                    eat();
                     func->is_c_function = true;
+                } else if (t.type == Token::DIRECTIVE_INLINE || t.type == Token::DIRECTIVE_NOINLINE) {
+                    if (func->inlining != Function::INLINE_AUTO) {
+                        report_error("only one of @inline and @noinline per function");
+                    }
+
+                    eat();
+                    func->inlining = (t.type == Token::DIRECTIVE_INLINE) ? Function::INLINE_ALWAYS
+                                                                         : Function::INLINE_NEVER;
                 } else if (t.type == Token::IDENTIFIER) {
                     break;
                 } else {
-                    lexer->report_error("expected function attributes (directives) or function name");
+                    report_error("expected function attributes (directives) or function name");
                 }
             }
         }
 
-        lexer->expect(Token::IDENTIFIER);
+        expect(Token::IDENTIFIER);
 
-        func->name = lexer->token().str_value;
+        func->name = token().atom;
 
-        lexer->eat();
-        lexer->expect_and_eat('(');
+        eat();
+        expect_and_eat('(');
 
-        auto func_type = new Function_Type;
+        Array<Type *> argument_types;
 
-        auto func_scope = new Scope;
+        auto func_scope = arena->make<Scope>(arena);
         func_scope->parent = scope_stack.back();
         scope_stack.push_back(func_scope);
 
         while (true) {
             auto arg = parse_variable();
             func->arguments.push_back(arg);
-            func_type->arguments.push_back(arg->var_type); // @cleanup
+            argument_types.push_back(arg->var_type);
 
-            if (lexer->token().type == ',') {
-                lexer->eat();
-            } else if (lexer->token().type == ')') {
+            if (token().type == ',') {
+                eat();
+            } else if (token().type == ')') {
                 break;
             } else {
                 assert(false);
@@ -289,17 +455,23 @@ struct Parser {
 
         scope_stack.pop_back();
 
-        lexer->expect_and_eat(')');
-        lexer->expect_and_eat(Token::ARROW);
+        expect_and_eat(')');
+        expect_and_eat(Token::ARROW);
+
+        auto return_type = parse_type();
+        func->func_type = module->types->function_type(
+                argument_types.data(), argument_types.size(), return_type);
 
-        func_type->return_type = parse_type();
-        func->func_type = func_type;
+        if (token().type == '{') {
+            if (!defer_body(func, func_scope)) {
+                u32 first_token = token_index;
 
-        if (lexer->token().type == '{') {
-            func->body = parse_block(func_scope);
-        } else if (lexer->token().type == ';') {
-            lexer->eat();
-            func->body = nullptr;
+                func->nodes = nodes;
+                func->body  = parse_block(func_scope);
+                func->body_token_count = token_index - first_token;
+            }
+        } else if (token().type == ';') {
+            eat();
         } else {
             assert(false);
         }
@@ -307,23 +479,98 @@ struct Parser {
         return func;
     }
 
-    Module *parse_module(Lexer *l) {
+    // Skips the body at the current token if the pre-pass knows where it
+    // ends, and leaves it for parse_deferred_bodies.
+    bool defer_body(Function *func, Scope *scope) {
+        if (!bodies) return false;
+
+        while (next_body < bodies->size() && (*bodies)[next_body].first < token_index) {
+            next_body++;
+        }
+
+        if (next_body == bodies->size()) return false;
+
+        auto range = (*bodies)[next_body];
+        if (range.first != token_index) return false;
+
+        // parse_function's caller appends func right after we return
+        deferred.push_back({func, (u32)module->functions.size(), scope, range.first});
+        token_index = range.last + 1;
+        next_body++;
+
+        return true;
+    }
+
+    // Each worker gets its own arena, node pool and scope stack. Worker 0 is
+    // this thread, so it keeps using ours. done(body) is called on the worker
+    // as soon as a body is parsed, in no particular order. If somebody reads
+    // the body from done() while the worker goes on with the next one, the
+    // pool would grow under them, so pool_per_body gives each its own.
+    template <typename Done>
+    void parse_deferred_bodies(u32 thread_count, bool pool_per_body, Done done) {
+        if (thread_count > deferred.size()) thread_count = deferred.size();
+
+        Array<Parser> workers(thread_count);
+
+        for (u32 w = 0; w < thread_count; w++) {
+            auto &worker = workers[w];
+            worker.lexer  = lexer;
+            worker.module = module;
+            worker.arena  = (w == 0) ? arena : arena->make<Arena>();
+            worker.nodes  = (w == 0) ? nodes : arena->make<Node_Pool>(worker.arena);
+            worker.scope_stack.push_back(module->scope);
+        }
+
+        parallel_for(deferred.size(), thread_count, [&](u32 i, u32 w) {
+            auto &worker = workers[w];
+            auto &body = deferred[i];
+
+            if (pool_per_body) worker.nodes = worker.arena->make<Node_Pool>(worker.arena);
+
+            // the scope was made with the signature, its locals grow from this thread now
+            body.scope->variables.arena = worker.arena;
+
+            worker.token_index = body.first_token;
+            body.func->nodes = worker.nodes;
+            body.func->body  = worker.parse_block(body.scope);
+            body.func->body_token_count = worker.token_index - body.first_token;
+
+            done(body);
+        });
+
+        deferred.clear();
+    }
+
+    // The first pass: globals and function signatures, and the bodies too
+    // unless defer_bodies is set, see the note above Parser.
+    Module *parse_declarations(Lexer *l, Arena *a, bool defer_bodies) {
 
         assert(scope_stack.size() == 0);
 
         lexer = l;
-        module = new Module;
-        module->scope = new Scope;
+        arena = a;
+        module = arena->make<Module>(arena);
+        module->scope = arena->make<Scope>(arena);
         module->scope->parent = nullptr;
+        module->nodes = arena->make<Node_Pool>(arena);
+        module->types = arena->make<Type_Pool>(arena);
+        nodes = module->nodes;
         scope_stack.push_back(module->scope);
 
+        Array<Token_Range> function_bodies;
+        if (defer_bodies) {
+            find_function_bodies(lexer, &function_bodies);
+            bodies = &function_bodies;
+        }
+
         while (true) {
-            if (lexer->token().type == Token::KEYWORD_FUNC) {
+            if (token().type == Token::KEYWORD_FUNC) {
                 auto func = parse_function();
+                func->index = module->functions.size();
                 module->functions.push_back(func);
-            } else if (lexer->token().type == Token::IDENTIFIER) {
-                auto var = parse_variable();
-                module->scope->variables.push_back(var);
+            } else if (token().type == Token::IDENTIFIER) {
+                // adds itself to the module scope
+                parse_variable();
             } else {
                 break;
             }
@@ -331,20 +578,154 @@ struct Parser {
 
         scope_stack.pop_back();
 
+        bodies = nullptr;
+        next_body = 0;
+
         return module;
 
     }
 
+    Module *parse_module(Lexer *l, Arena *a, u32 thread_count = 1) {
+        parse_declarations(l, a, thread_count > 1);
+
+        if (deferred.size()) {
+            parse_deferred_bodies(thread_count, false, [](Deferred_Body &) {});
+        }
+
+        return module;
+    }
+
 };
 
 };
 
-// @performance
-// Checking for re-declaration is O(n^2) with a large coefficient,
-// since we're using strcmp.
-AST::Variable *find_variable_in_scope(AST::Scope *scope, char *name) {
-    for (auto var : scope->variables) {
-        if (strcmp(var->name, name) == 0) {
+AST::Type_Pool::Type_Pool(Arena *a) {
+    arena = a;
+    void_type = arena->make<Void_Type>();
+
+    for (u32 is_unsigned = 0; is_unsigned < 2; is_unsigned++) {
+        for (u32 i = 0; i < 4; i++) {
+            integer_types[is_unsigned][i] = arena->make<Integer_Type>(1 << i, is_unsigned);
+        }
+    }
+}
+
+AST::Integer_Type *AST::Type_Pool::integer_type(u8 size, bool is_unsigned) {
+    switch (size) {
+        case 1: return integer_types[is_unsigned][0];
+        case 2: return integer_types[is_unsigned][1];
+        case 4: return integer_types[is_unsigned][2];
+        case 8: return integer_types[is_unsigned][3];
+        default: assert(false && "no integer type of this size"); return nullptr;
+    }
+}
+
+// Parts are canonical already, so hashing their addresses is enough
+internal u32 function_type_hash(AST::Type **arguments, u32 argument_count, AST::Type *return_type) {
+    u64 hash = (u64)(uintptr_t)return_type * 0x9e3779b97f4a7c15ull;
+    for (u32 i = 0; i < argument_count; i++) {
+        hash = (hash ^ (u64)(uintptr_t)arguments[i]) * 0x9e3779b97f4a7c15ull;
+    }
+    return (u32)(hash >> 32);
+}
+
+AST::Function_Type *AST::Type_Pool::function_type(Type **arguments, u32 argument_count, Type *return_type) {
+    if ((function_count + 1) * 2 > function_capacity) {
+        u32 old_capacity = function_capacity;
+        auto old_slots   = function_slots;
+
+        function_capacity = old_capacity ? old_capacity * 2 : 64;
+        function_slots = (Function_Type **)arena->allocate(function_capacity * sizeof(Function_Type *), alignof(Function_Type *));
+        memset(function_slots, 0, function_capacity * sizeof(Function_Type *));
+
+        for (u32 i = 0; i < old_capacity; i++) {
+            auto ft = old_slots[i];
+            if (!ft) continue;
+
+            u32 j = function_type_hash(ft->arguments.data(), ft->arguments.size(), ft->return_type);
+            while (function_slots[j & (function_capacity - 1)]) j++;
+            function_slots[j & (function_capacity - 1)] = ft;
+        }
+    }
+
+    u32 mask = function_capacity - 1;
+    u32 i = function_type_hash(arguments, argument_count, return_type) & mask;
+
+    for (; function_slots[i]; i = (i + 1) & mask) {
+        auto ft = function_slots[i];
+        if (ft->return_type == return_type &&
+            ft->arguments.size() == argument_count &&
+            memcmp(ft->arguments.data(), arguments, argument_count * sizeof(Type *)) == 0) {
+            return ft;
+        }
+    }
+
+    auto ft = arena->make<Function_Type>(arena);
+    ft->arguments.assign(arguments, argument_count);
+    ft->return_type = return_type;
+
+    function_slots[i] = ft;
+    function_count++;
+
+    return ft;
+}
+
+internal u32 scope_hash(Atom name, u32 capacity) {
+    return (name.id * 2654435769u) & (capacity - 1);
+}
+
+void AST::Scope::add_variable(Variable *var) {
+    variables.push_back(var);
+
+    bool wants_index = (parent == nullptr) || (variables.size() > scope_index_threshold);
+    if (!wants_index) return;
+
+    if (variables.size() * 2 > index_capacity) {
+        // also takes care of indexing everything for the first time
+        grow_index();
+        return;
+    }
+
+    u32 i = scope_hash(var->name, index_capacity);
+    while (index[i]) {
+        // redeclared, the first one wins like in the linear search
+        if (atom_match(index[i]->name, var->name)) return;
+        i = (i + 1) & (index_capacity - 1);
+    }
+    index[i] = var;
+}
+
+// The old index stays in the arena until it's released
+void AST::Scope::grow_index() {
+    index_capacity = index_capacity ? index_capacity * 2 : 32;
+    while (variables.size() * 2 > index_capacity) index_capacity *= 2;
+
+    index = (Variable **)variables.arena->allocate(index_capacity * sizeof(Variable *), alignof(Variable *));
+    memset(index, 0, index_capacity * sizeof(Variable *));
+
+    for (auto var : variables) {
+        u32 i = scope_hash(var->name, index_capacity);
+        bool redeclared = false;
+        while (index[i]) {
+            if (atom_match(index[i]->name, var->name)) redeclared = true;
+            i = (i + 1) & (index_capacity - 1);
+        }
+        if (!redeclared) index[i] = var;
+    }
+}
+
+AST::Variable *AST::Scope::find(Atom name) {
+    if (index) {
+        u32 i = scope_hash(name, index_capacity);
+        while (index[i]) {
+            if (atom_match(index[i]->name, name)) return index[i];
+            i = (i + 1) & (index_capacity - 1);
+        }
+        return nullptr;
+    }
+
+    for (auto var : variables) {
+        if (atom_match(var->name, name)) {
             return var;
         }
     }
@@ -352,11 +733,14 @@ AST::Variable *find_variable_in_scope(AST::Scope *scope, char *name) {
     return nullptr;
 }
 
+AST::Variable *find_variable_in_scope(AST::Scope *scope, Atom name) {
+    return scope->find(name);
+}
+
 // Find variable, walking up the chain of scopes
-// @performance sucks
-AST::Variable *find_variable(AST::Scope *scope, char *name) {
+AST::Variable *find_variable(AST::Scope *scope, Atom name) {
     while (scope) {
-        if (auto var = find_variable_in_scope(scope, name)) {
+        if (auto var = scope->find(name)) {
             return var;
         }
 
@@ -365,4 +749,3 @@ AST::Variable *find_variable(AST::Scope *scope, char *name) {
 
     return nullptr;
 }
-
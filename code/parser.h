@@ -1,19 +1,25 @@
 
-// @TODO: only create new types when there are actually new types
-// maybe use a type pool.
-
 namespace IL {
-    struct Value;
+    typedef u32 Value_Id;
+}
+
+namespace llvm {
+    class Type;
 }
 
 namespace AST {
 
+    // @note: types are canonical, see Type_Pool, so equal types are the
+    // same pointer.
     struct Type {
         enum _Type : u32 {
             VOID,
             INTEGER,
             FUNCTION
         } type;
+
+        // set by the LLVM converter, only valid for its context
+        llvm::Type *llvm_type = nullptr;
     };
 
     struct Void_Type : Type {
@@ -31,12 +37,30 @@ namespace AST {
     };
 
     struct Function_Type : Type {
-        Function_Type() { type = FUNCTION; }
+        Function_Type(Arena *arena) : arguments(arena) { type = FUNCTION; }
 
-        Array<Type *> arguments;
+        Arena_Array<Type *> arguments;
         Type *return_type;
     };
 
+    // Hands out one instance per distinct type. Primitive types are made up
+    // front, function types are hash-consed on their canonical parts.
+    struct Type_Pool {
+        Arena *arena;
+
+        Void_Type *void_type;
+        Integer_Type *integer_types[2][4]; // [is_unsigned][log2(size)]
+
+        Function_Type **function_slots = nullptr; // open addressing, in the arena
+        u32 function_capacity = 0;                // power of two
+        u32 function_count = 0;
+
+        Type_Pool(Arena *arena);
+
+        Integer_Type *integer_type(u8 size, bool is_unsigned = false);
+        Function_Type *function_type(Type **arguments, u32 argument_count, Type *return_type);
+    };
+
     enum {
         INT_LITERAL,
         IDENTIFIER,
@@ -52,109 +76,215 @@ namespace AST {
         MODULE
     };
 
-    struct Node {
-        u32 type;
-    };
+    /* @note
+     * Function bodies are stored flat: each kind of node lives in its own
+     * contiguous pool in the function's Node_Pool, and nodes refer to their
+     * children with 32-bit handles instead of pointers. The top 4 bits of a
+     * handle are the node kind, the rest is the index into that pool.
+     * Children of calls and blocks sit next to each other in Node_Pool::lists.
+     */
+    typedef u32 Handle;
 
-    struct Expreesion : Node {};
+    const Handle no_node = ~0u;
 
-    struct Int_Literal : Expreesion {
-        Int_Literal() { type = INT_LITERAL; }
+    inline Handle make_handle(u32 kind, u32 index) {
+        assert(index < (1u << 28));
+        return (kind << 28) | index;
+    }
 
-        u64 value;
-    };
+    inline u32 handle_kind(Handle h)  { return h >> 28; }
+    inline u32 handle_index(Handle h) { return h & ((1u << 28) - 1); }
 
-    struct Identifier : Expreesion {
-        Identifier() { type = IDENTIFIER; }
+    inline bool is_expression(Handle h) {
+        u32 kind = handle_kind(h);
+        return kind == INT_LITERAL || kind == IDENTIFIER || kind == BINARY ||
+               kind == UNARY || kind == FUNCTION_CALL;
+    }
 
-        char *name;
+    struct Node {
+        u32 type;
     };
 
-    struct Binary : Expreesion {
-        Binary() { type = BINARY; }
-
+    struct Binary {
         u32 op;
-
-        Expreesion *lhs, *rhs;
+        Handle lhs, rhs;
     };
 
-    struct Unary : Expreesion {
-        Unary() { type = UNARY; }
-
+    struct Unary {
         u32 op;
-
-        Expreesion *operand;
+        Handle operand;
     };
 
-    struct Function_Call : Expreesion {
-        Function_Call() { type = FUNCTION_CALL; }
-
-        char *name;
-        Array<Expreesion *> arguments;
+    struct Function_Call {
+        Atom name;
+        u32 first_argument; // into Node_Pool::lists
+        u32 argument_count;
     };
 
     struct Variable : Node {
         Variable() { type = VARIABLE; }
 
         Type *var_type;
-        char *name;
-        Expreesion *initial_value;
+        Atom name;
+        Handle initial_value;
 
-        // for IL conversion
-        IL::Value *address = nullptr;
+        // for IL conversion, the value number of its alloca
+        IL::Value_Id address = ~0u;
     };
 
-    struct Assign : Node {
-        Assign() { type = ASSIGN; }
-
-        Expreesion *lhs, *rhs;
+    struct Assign {
+        Handle lhs, rhs;
     };
 
+    /* @note
+     * Most scopes hold a handful of variables and are searched linearly.
+     * Past scope_index_threshold variables a scope also keeps an open
+     * addressing index from atom to variable, so functions with thousands of
+     * locals don't make lookups quadratic. The module scope, which every
+     * lookup of a global ends up in, is always indexed.
+     */
+    const u32 scope_index_threshold = 8;
+
     struct Scope : Node {
+        Scope(Arena *arena) : variables(arena) {}
+
         Scope *parent;
-        Array<Variable *> variables;
-    };
+        Arena_Array<Variable *> variables; // in declaration order
+
+        Variable **index = nullptr; // nullptr is an empty slot, in the arena
+        u32 index_capacity = 0;     // power of two, at most half full
 
-    struct Block : Node {
-        Block() { type = BLOCK; }
+        void add_variable(Variable *var);
+        Variable *find(Atom name);
+        void grow_index();
+    };
 
+    struct Block {
         Scope *scope;
-        Array<Node *> statements;
+        u32 first_statement; // into Node_Pool::lists
+        u32 statement_count;
+    };
+
+    struct While {
+        Handle condition;
+        Handle body; // a BLOCK
+    };
+
+    struct Return {
+        Handle return_value; // or no_node
     };
 
-    struct While : Node {
-        While() { type = WHILE; }
+    // A run of handles in Node_Pool::lists, for range-for
+    struct Handle_List {
+        Handle *first;
+        u32 count;
 
-        Expreesion *condition;
-        Block *body;
+        Handle *begin() { return first; }
+        Handle *end()   { return first + count; }
+        u32 size()      { return count; }
+        Handle operator[](u32 i) { return first[i]; }
     };
 
-    struct Return : Node {
-        Return() { type = RETURN; }
+    // Grows in the arena it's made with, which has to be the one of the
+    // thread that parses into it
+    struct Node_Pool {
+        Node_Pool(Arena *arena)
+            : int_literals(arena), identifiers(arena), binaries(arena), unaries(arena),
+              calls(arena), variables(arena), assigns(arena), whiles(arena), returns(arena),
+              blocks(arena), lists(arena) {}
+
+        Arena_Array<u64>           int_literals;
+        Arena_Array<Atom>          identifiers;
+        Arena_Array<Binary>        binaries;
+        Arena_Array<Unary>         unaries;
+        Arena_Array<Function_Call> calls;
+        Arena_Array<Variable *>    variables;
+        Arena_Array<Assign>        assigns;
+        Arena_Array<While>         whiles;
+        Arena_Array<Return>        returns;
+        Arena_Array<Block>         blocks;
+
+        Arena_Array<Handle> lists;
+
+        template <typename T>
+        Handle push(Arena_Array<T> &pool, u32 kind, T node) {
+            pool.push_back(node);
+            return make_handle(kind, pool.size() - 1);
+        }
+
+        // Appends a run of handles to lists, returns where it starts
+        u32 push_list(Handle *handles, u32 count) {
+            u32 first = lists.size();
+            lists.append(handles, count);
+            return first;
+        }
+
+        u64            int_literal(Handle h) { assert(handle_kind(h) == INT_LITERAL);   return int_literals[handle_index(h)]; }
+        Atom           identifier(Handle h)  { assert(handle_kind(h) == IDENTIFIER);    return identifiers[handle_index(h)]; }
+        Binary        &binary(Handle h)      { assert(handle_kind(h) == BINARY);        return binaries[handle_index(h)]; }
+        Unary         &unary(Handle h)       { assert(handle_kind(h) == UNARY);         return unaries[handle_index(h)]; }
+        Function_Call &call(Handle h)        { assert(handle_kind(h) == FUNCTION_CALL); return calls[handle_index(h)]; }
+        Variable      *variable(Handle h)    { assert(handle_kind(h) == VARIABLE);      return variables[handle_index(h)]; }
+        Assign        &assign(Handle h)      { assert(handle_kind(h) == ASSIGN);        return assigns[handle_index(h)]; }
+        While         &while_loop(Handle h)  { assert(handle_kind(h) == WHILE);         return whiles[handle_index(h)]; }
+        Return        &ret(Handle h)         { assert(handle_kind(h) == RETURN);        return returns[handle_index(h)]; }
+        Block         &block(Handle h)       { assert(handle_kind(h) == BLOCK);         return blocks[handle_index(h)]; }
+
+        Handle_List arguments(Function_Call &call) {
+            Handle_List list;
+            list.first = lists.data() + call.first_argument;
+            list.count = call.argument_count;
+            return list;
+        }
 
-        Expreesion *return_value;
+        Handle_List statements(Block &block) {
+            Handle_List list;
+            list.first = lists.data() + block.first_statement;
+            list.count = block.statement_count;
+            return list;
+        }
     };
 
     struct Function : Node {
-        Function() { type = FUNCTION; }
+        Function(Arena *arena) : arguments(arena) { type = FUNCTION; }
 
         // @TODO: pack bools into an int
         bool is_c_function = false;
 
+        // what @inline / @noinline asked the IL inliner for
+        enum Inlining : u8 { INLINE_AUTO, INLINE_ALWAYS, INLINE_NEVER };
+        Inlining inlining = INLINE_AUTO;
+
         Function_Type *func_type;
-        Array<Variable *> arguments;
-        char *name;
-        Block *body;
+        Arena_Array<Variable *> arguments;
+        Atom name;
+        u32 index; // in Module::functions, the IL module's too
+
+        Node_Pool *nodes; // the pool body lives in
+        Handle body;      // a BLOCK, or no_node for declarations
+        u32 body_token_count = 0; // a cheap estimate of its size for later stages
     };
 
     struct Module : Node {
-        Module() { type = MODULE; }
+        Module(Arena *arena) : functions(arena) { type = MODULE; }
 
         Scope *scope;
-        Array<Function *> functions;
+        Arena_Array<Function *> functions;
+        Type_Pool *types;
+
+        // function bodies and initial values of globals
+        Node_Pool *nodes;
     };
 
+    // None of the AST needs a finalizer, it goes with the arena's chunks
+    static_assert(std::is_trivially_destructible<Scope>::value &&
+                  std::is_trivially_destructible<Function>::value &&
+                  std::is_trivially_destructible<Function_Type>::value &&
+                  std::is_trivially_destructible<Type_Pool>::value &&
+                  std::is_trivially_destructible<Node_Pool>::value &&
+                  std::is_trivially_destructible<Module>::value, "AST nodes are dropped with their chunks");
+
 };
 
-AST::Variable *find_variable_in_scope(AST::Scope *scope, char *name);
-AST::Variable *find_variable(AST::Scope *scope, char *name);
+AST::Variable *find_variable_in_scope(AST::Scope *scope, Atom name);
+AST::Variable *find_variable(AST::Scope *scope, Atom name);
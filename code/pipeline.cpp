@@ -0,0 +1,87 @@
+
+/* @note
+ * Pipelined compilation, for when we have more than one thread.
+ * The parser's first pass (Parser::parse_declarations) settles the module
+ * scope and every signature, so the LLVM module can declare all functions up
+ * front. After that every function body goes through three stages that run
+ * at the same time:
+ *
+ *     parse workers --parsed--> IL conversion --converted--> LLVM lowering
+ *
+ * connected by bounded queues of indices into Module::functions. A stage only
+ * touches the function it's handed, so the total time approaches that of the
+ * slowest stage instead of the sum of them. Functions finish out of order,
+ * but they're stored by index, so both modules still come out in source order.
+ * Functions are lowered as soon as they're converted, so only the function
+ * passes that run at conversion fit in here, not module passes.
+ */
+const u32 pipeline_queue_size = 64;
+
+internal IL::Module *compile_pipelined(Lexer *lexer, Arena *arena,
+                                       llvm_conv::LLVM_Converter *converter,
+                                       IL::Pass_Manager *passes,
+                                       u32 thread_count) {
+    assert(passes->first_module_pass == passes->passes.size());
+
+    AST::Parser parser;
+    auto module_ast = parser.parse_declarations(lexer, arena, true);
+    u32 function_count = module_ast->functions.size();
+
+    auto module_il = arena->make<IL::Module>();
+    module_il->globals.assign(module_ast->scope->variables.begin(), module_ast->scope->variables.end());
+    module_il->functions.resize(function_count, nullptr);
+
+    llvm_conv::begin_module(converter, module_ast);
+
+    Bounded_Queue<u32> parsed(pipeline_queue_size);
+    Bounded_Queue<u32> converted(pipeline_queue_size);
+
+    // the parser keeps allocating from arena while we convert
+    auto il_arena = arena->make<Arena>();
+
+    // set up here, the atom table grows once the parse workers start
+    IL::Convert_Context ctx;
+    ctx.arena  = il_arena;
+    ctx.scope  = module_ast->scope;
+    ctx.passes = passes;
+    IL::index_functions(&ctx, module_ast);
+
+    std::thread il_stage([&]() {
+        u32 i;
+        while (parsed.pop(&i)) {
+            module_il->functions[i] = IL::convert_function(&ctx, module_ast->functions[i]);
+            converted.push(i);
+        }
+
+        converted.close();
+    });
+
+    std::thread llvm_stage([&]() {
+        u32 i;
+        while (converted.pop(&i)) {
+            llvm_conv::convert_function(converter, module_il->functions[i]);
+        }
+    });
+
+    // declarations, and bodies the first pass parsed itself, are done already
+    Array<u8> pending(function_count, 0);
+    for (auto &body : parser.deferred) pending[body.function_index] = 1;
+
+    for (u32 i = 0; i < function_count; i++) {
+        if (!pending[i]) parsed.push(i);
+    }
+
+    // the other two stages get a thread each
+    u32 parse_thread_count = (thread_count > 3) ? thread_count - 2 : 1;
+
+    parser.parse_deferred_bodies(parse_thread_count, true, [&](AST::Parser::Deferred_Body &body) {
+        parsed.push(body.function_index);
+    });
+
+    parsed.close();
+
+    il_stage.join();
+    llvm_stage.join();
+
+    return module_il;
+}
@@ -2,10 +2,22 @@
 #include "unnamed.h"
 #include "compiler.h"
 
+#include "arena.cpp"
 #include "lexer.cpp"
 #include "parser.cpp"
 #include "il.cpp"
+#include "il_analysis.cpp"
+#include "il_ssa.cpp"
+#include "il_gvn.cpp"
+#include "il_dce.cpp"
+#include "il_loops.cpp"
+#include "il_ranges.cpp"
+#include "il_strength.cpp"
+#include "il_calls.cpp"
+#include "il_inline.cpp"
+#include "il_passes.cpp"
 #include "llvm_converter.cpp"
+#include "pipeline.cpp"
 // #include "bytecode.cpp"
 
 int main(i32 argc, char **argv) {
@@ -19,6 +31,13 @@ int main(i32 argc, char **argv) {
                 assert(i < argc);
                 options.output_filename = argv[i];
                 continue;
+            } else if (string_match(option, "-j")) {
+                i += 1;
+                assert(i < argc);
+                options.thread_count = strtoul(argv[i], nullptr, 10);
+                continue;
+            } else if (string_match(option, "-stats")) {
+                options.print_statistics = true;
             } else if (string_match(option, "-O0")) {
                 options.optimization_level = 0;
             } else if (string_match(option, "-O1")) {
@@ -41,24 +60,70 @@ int main(i32 argc, char **argv) {
         return 1;
     }
 
-    char *source_content = read_entire_file(options.input_filename);
+    char *source_content = map_entire_file(options.input_filename);
 
     if (!source_content) {
         printf("Cannot open source file: %s\n", options.input_filename);
         return 1;
     }
 
+    u32 thread_count = resolve_thread_count(options.thread_count);
+
     Lexer lexer(source_content);
-    lexer.tokenize();
+    lexer.tokenize_parallel(thread_count);
+
+    // everything the AST and IL need lives as long as the compilation unit
+    Arena arena;
+
+    // the inliner is a module pass, so -O0 only runs it if it has to
+    bool has_forced_inlines = false;
+    for (auto type : lexer.token_types) {
+        if (type == Token::DIRECTIVE_INLINE) {
+            has_forced_inlines = true;
+            break;
+        }
+    }
 
-    AST::Parser parser;    
-    auto module_ast = parser.parse_module(&lexer);
+    IL::Pass_Manager passes;
+    IL::build_pipeline(&passes, options.optimization_level, has_forced_inlines);
 
-    auto module_il = IL::convert_module(module_ast);
+    IL::Module *module_il;
+    llvm::Module *llvm_module;
 
-    print_il_module(module_il);
+    // module passes need every function converted before any is lowered
+    bool has_module_passes = passes.first_module_pass < passes.passes.size();
 
-    auto llvm_module = llvm_conv::convert_module(module_il);
+    if (thread_count > 1 && !has_module_passes) {
+        llvm_conv::LLVM_Converter converter;
+        module_il = compile_pipelined(&lexer, &arena, &converter, &passes, thread_count);
+
+        print_il_module(module_il);
+        if (options.print_statistics) {
+            print_pass_stats(&passes);
+            print_value_numbering_stats(module_il);
+            print_dead_code_stats(module_il);
+            print_range_stats(module_il);
+            print_strength_stats(module_il);
+        }
+
+        llvm_module = llvm_conv::finish_module(&converter);
+    } else {
+        AST::Parser parser;
+        auto module_ast = parser.parse_module(&lexer, &arena, thread_count);
+
+        module_il = IL::convert_module(module_ast, &arena, &passes);
+
+        print_il_module(module_il);
+        if (options.print_statistics) {
+            print_pass_stats(&passes);
+            print_value_numbering_stats(module_il);
+            print_dead_code_stats(module_il);
+            print_range_stats(module_il);
+            print_strength_stats(module_il);
+        }
+
+        llvm_module = llvm_conv::convert_module(module_ast, module_il);
+    }
 
     llvm_conv::emit_object_file(llvm_module);
 
@@ -2,9 +2,30 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 // @TODO: use std::vector for now
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 template <typename A>
 using Array = std::vector<A>;
@@ -23,10 +44,23 @@ typedef int8_t  i8;
 #define global_variable static
 #define local_persist   static
 
+// A view into memory owned by someone else, usually the source text.
+// Not '\0' terminated, print it with "%.*s", (int)s.length, s.data
+struct String {
+    char *data;
+    u32 length;
+};
+
 internal bool string_match(const char *x, const char *y) {
     return (strcmp(x, y) == 0);
 }
 
+internal bool string_match(String x, const char *y) {
+    return strlen(y) == x.length && memcmp(x.data, y, x.length) == 0;
+}
+
+#include "parallel.h"
+#include "arena.h"
 #include "lexer.h"
 #include "parser.h"
 // #include "bytecode.h"
@@ -9,3 +9,4 @@ mkdir -p build
 
 # ${CXX} $* code/unnamed.cpp $LLVM_Flags -ftime-trace -o build/unnamed
 ${CXX} $* code/unnamed.cpp $LLVM_Flags -o build/unnamed
+${CXX} $* -O2 -pthread code/bench.cpp -o build/bench